@@ -4,17 +4,20 @@ python="OFF"
 exe="OFF"
 test="OFF"
 gprofile="OFF"
-while getopts ":petg" "opt"; do
+embed="OFF"
+while getopts ":petgm" "opt"; do
     case ${opt} in
         "p" ) python="ON" ;;
         "e" ) exe="ON" ;;
         "t" ) test="ON" ;;
         "g" ) gprofile="ON";;
+        "m" ) embed="ON";;
         * ) echo "Usage: cmd [-p] [-e]"
             echo "  -p: build python module"
             echo "  -e: build executable"
             echo "  -t: run tests, only valid when python module is built"
             echo "  -g: enable gprof profiling"
+            echo "  -m: compile the model weights into the binary"
             exit 1
             ;;
     esac
@@ -46,7 +49,7 @@ fi
 
 mkdir build
 cd build
-cmake .. -DBUILD_PY=${python} -DBUILD_EXE=${exe} -DGPROF=${gprofile}
+cmake .. -DBUILD_PY=${python} -DBUILD_EXE=${exe} -DGPROF=${gprofile} -DEMBED_MODEL=${embed}
 make
 cd ..
 
@@ -58,6 +61,11 @@ if [ ${python} == "ON" ]; then
     fi
 fi
 
+# convert the json models to the binary model files loaded by default
+if [ ${exe} == "ON" ]; then
+    ./bin/convert_model
+fi
+
 # if executable is built and gprof is enabled, run the executable and generate profiling report
 if [ ${exe} == "ON" ] && [ ${gprofile} == "ON" ]; then
     ./bin/run && gprof bin/run gmon.out > ./log/profiling.txt
@@ -1,29 +1,63 @@
 from BasiCPP_Pitch.note import Note
 from BasiCPP_Pitch import amtModel
 import pretty_midi
+import numpy as np
 from typing import List
 
-def note2midi( notes: List[Note], midi_tempo: float = 115 ) -> pretty_midi.PrettyMIDI:
+CONTOURS_BINS_PER_SEMITONE = 3
+N_PITCH_BEND_TICKS = 8192
+
+def overlapping_notes( notes: List[Note] ) -> List[bool]:
+    """Same as basic_pitch drop_overlapping_pitch_bends, flag notes overlapping another one
+
+    Args:
+        notes (List[Note]): List of notes
+
+    Returns:
+        List[bool]: True for the notes whose bends would also bend another sounding note
+    """
+    order = sorted(range(len(notes)), key=lambda i: notes[i].start)
+    overlapping = [False] * len(notes)
+    for a, i in enumerate(order):
+        for j in order[a + 1:]:
+            if notes[j].start >= notes[i].end:
+                break
+            overlapping[i] = overlapping[j] = True
+    return overlapping
+
+def note2midi( notes: List[Note], midi_tempo: float = 115, include_pitch_bends: bool = True ) -> pretty_midi.PrettyMIDI:
     """Convert notes to midi file
 
     Args:
         notes (List[Note]): List of notes
         midi_tempo (float, optional): Tempo of midi file. Defaults to 120.
+        include_pitch_bends (bool, optional): Write note bends as pitch wheel events, bends of overlapping
+            notes are dropped since all notes share one instrument. Defaults to True.
 
     Returns:
         pretty_midi.PrettyMIDI: Midi file
     """
     midi = pretty_midi.PrettyMIDI(initial_tempo=midi_tempo)
     instrument = pretty_midi.Instrument(program=0)
+    overlapping = overlapping_notes(notes) if include_pitch_bends else [False] * len(notes)
 
-    for note in notes:
-        note = pretty_midi.Note(
+    for note, overlaps in zip(notes, overlapping):
+        instrument.notes.append(pretty_midi.Note(
             velocity=round(note.amplitude * 127),
             pitch=note.pitch,
             start=note.start,
             end=note.end
-        )
-        instrument.notes.append(note)
+        ))
+
+        # same as basic_pitch, bends beyond 2 semitones are cropped
+        if include_pitch_bends and not overlaps and len(note.bends) > 0:
+            pb_times = np.linspace(note.start, note.end, len(note.bends))
+            pb_ticks = np.round(np.array(note.bends) * 4096 / CONTOURS_BINS_PER_SEMITONE).astype(int)
+            pb_ticks = np.clip(pb_ticks, -N_PITCH_BEND_TICKS, N_PITCH_BEND_TICKS - 1)
+            for pb_time, pb_tick in zip(pb_times, pb_ticks):
+                instrument.pitch_bends.append(pretty_midi.PitchBend(int(pb_tick), pb_time))
+            # center the wheel so the next note starts unbent
+            instrument.pitch_bends.append(pretty_midi.PitchBend(0, note.end))
 
     midi.instruments.append(instrument)
     return midi
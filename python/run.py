@@ -1,6 +1,3 @@
-import librosa
-from midi_utils import note2midi
-
 # Specify the input audio file path
 audio_file_path = "data/Undertale-Megalovania.wav"
 # audio_file_path = "../data/Undertale-Megalovania.wav"
@@ -9,7 +6,8 @@ audio_file_path = "data/Undertale-Megalovania.wav"
 midi_file_path = "data/output/Undertale-Megalovania.mid"
 
 def getExampleAudio():
-    sig, _  = librosa.load(audio_file_path, sr=22050, mono=True)
+    # decoded, downmixed and resampled to 22050 Hz natively
+    sig, _ = BasiCPP_Pitch.loadWav(audio_file_path)
     return sig
 
 def main():
@@ -20,10 +18,9 @@ def main():
     # Initialize the model
     model = BasiCPP_Pitch.amtModel()
 
-    # Transcribe the audio and generate the MIDI file
+    # Transcribe the audio and write the MIDI file natively
     notes = model.transcribeAudio(audio)
-    midi = note2midi(notes)
-    midi.write(midi_file_path)
+    BasiCPP_Pitch.midi.writeMidi(notes, midi_file_path)
 
 if __name__ == "__main__":
     try:
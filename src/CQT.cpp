@@ -37,7 +37,7 @@ CQParams::CQParams( bool contour ) {
     frame_per_second = static_cast<int>(static_cast<float>(sample_rate) / sample_per_frame);
 }
 
-CQ::CQ() : params(CQParams(true)) {
+CQ::CQ( const std::string& model_dir ) : params(CQParams(true)) {
     // Compute the length of the kernels for later normalization
     int _n_bins = params.n_bins;
     _lengths = Vectorcf::Zero(_n_bins);
@@ -48,30 +48,30 @@ CQ::CQ() : params(CQParams(true)) {
         _lengths[i] = _l_sqrt_complex;
     }
 
-    loadDefaultKernel(_kernel);
-    loadDefaultLowPassFilter(_filter_kernel);
+    _kernel = mapDefaultKernel(_kernel_rows, _kernel_cols, model_dir);
+    loadDefaultLowPassFilter(_filter_kernel, model_dir);
 }
 
 CQ::~CQ() = default;
 
-Matrixcf CQ::forward( const Vectorf &x, int hop_length ) {
+Matrixcf CQ::forward( const VectorfRef &x, int hop_length ) const {
 
     // due to the reflection padding, the output size plus 1
     int n_fft_x = x.size() / hop_length + 1;
     Vectorf padded_x = reflectionPadding(x, params.fft_window_size / 2);
-    Matrixcf cqt_feat = Matrixcf::Zero(n_fft_x, _kernel.rows());
+    Matrixcf cqt_feat = Matrixcf::Zero(n_fft_x, _kernel_rows);
 
     for ( int i = 0 ; i < n_fft_x ; i++ ) {
         int start = i * hop_length;
         Vectorcf temp = padded_x.segment(start, params.fft_window_size).cast<std::complex<float>>();
-        cqt_feat.row(i) = temp * _kernel.transpose();
+        cqt_feat.row(i) = temp * kernel().transpose();
     }
 
     return cqt_feat.transpose();
 }
 
 // output shape = (n_harmonics, n_frames, n_bins)
-VecMatrixf CQ::harmonicStacking(const Matrixf& cqt , int bins_per_semitone, std::vector<float> harmonics, int n_output_freqs) {
+VecMatrixf CQ::harmonicStacking(const Matrixf& cqt , int bins_per_semitone, std::vector<float> harmonics, int n_output_freqs) const {
     
     int n_bins = cqt.rows(), n_frames = cqt.cols();
 
@@ -100,28 +100,32 @@ VecMatrixf CQ::harmonicStacking(const Matrixf& cqt , int bins_per_semitone, std:
 
 
 // Matrixf CQ::cqtEigen(const Vectorf& audio) {
-Matrixf CQ::computeCQT(const Vectorf& audio, bool batch_norm) {
+Matrixf CQ::computeCQT(const VectorfRef& audio, bool batch_norm) const {
     // NOTE : input audio should be 1D array at this point
     int hop = params.sample_per_frame;
     int n_fft_x = audio.size() / hop + 1;
-    int _n_bins = _kernel.rows();
+    int _n_bins = _kernel_rows;
 
     Matrixcf cqt_feat(params.n_bins, n_fft_x );
 
-    // Getting the top octave CQT
-    int start = params.n_bins - _n_bins;
-    cqt_feat.block(start , 0, _n_bins, n_fft_x) = forward(audio, hop);
-
-    Vectorf audio_down = audio;
-
+    // downsampled audio of every octave, each octave halves the previous one
+    // octave 0 reads the input view directly
+    std::vector<Vectorf> audio_octaves(params.n_octaves);
     for ( int i = 1 ; i < params.n_octaves ; i++ ) {
-        start -= _n_bins;
-        hop /= 2;
-        audio_down = downsamplingByN(audio_down, _filter_kernel, 2.0f);
+        audio_octaves[i] = downsamplingByN(i == 1 ? audio : VectorfRef(audio_octaves[i - 1]), _filter_kernel, 2.0f);
+    }
+
+    // octaves are independent once downsampled, octave 0 is the top octave
+    const int n_threads = getIntraOpThreads();
+#pragma omp parallel for num_threads(n_threads) if(n_threads > 1) schedule(dynamic)
+    for ( int i = 0 ; i < params.n_octaves ; i++ ) {
+        int start = params.n_bins - (i + 1) * _n_bins;
+        int octave_hop = hop >> i;
+        const VectorfRef octave_audio = i == 0 ? audio : VectorfRef(audio_octaves[i]);
         if (start >= 0)
-            cqt_feat.block(start, 0, _n_bins, n_fft_x) = forward(audio_down, hop);
+            cqt_feat.block(start, 0, _n_bins, n_fft_x) = forward(octave_audio, octave_hop);
         else
-            cqt_feat.block(0, 0, _n_bins + start, n_fft_x) = forward(audio_down, hop).block(-start, 0, _n_bins + start, n_fft_x);
+            cqt_feat.block(0, 0, _n_bins + start, n_fft_x) = forward(octave_audio, octave_hop).block(-start, 0, _n_bins + start, n_fft_x);
     }
 
     // normalization
@@ -148,7 +152,7 @@ Matrixf CQ::computeCQT(const Vectorf& audio, bool batch_norm) {
 }
 
 // Matrixf CQ::cqtEigenHarmonic(const Vectorf& audio) {
-VecMatrixf CQ::cqtHarmonic(const Vectorf& audio, bool batch_norm) {
+VecMatrixf CQ::cqtHarmonic(const VectorfRef& audio, bool batch_norm) const {
 
     // Matrixf cqt_feat = cqtEigen(audio);
     Matrixf cqt_feat = computeCQT(audio, batch_norm);
@@ -167,10 +171,10 @@ VecMatrixf CQ::cqtHarmonic(const Vectorf& audio, bool batch_norm) {
     return hs;
 }
 
-Matrixcf CQ::getKernel() {
-    return _kernel;
+Matrixcf CQ::getKernel() const {
+    return kernel();
 }
 
-Vectorf CQ::getFilter() {
+Vectorf CQ::getFilter() const {
     return _filter_kernel;
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "typedef.h"
+#include "constant.h"
+#include <complex>
+#include <memory>
+#include <string>
 #include <vector>
 
 class CQParams {
@@ -30,27 +34,32 @@ class CQParams {
 
 class CQ {
     public:
-        CQ();
+        // kernels from model_dir/kernel.npy and model_dir/lowpass_filter.npy
+        CQ( const std::string& model_dir = DEFAULT_MODEL_DIR );
         ~CQ();
 
         // compute cqt API for Eigen IO
         // Matrixf cqtEigen(const Vectorf& x);
-        Matrixf computeCQT(const Vectorf& x, bool batch_norm);
+        Matrixf computeCQT(const VectorfRef& x, bool batch_norm) const;
 
         // Return the cqt feature with harmonic stacking, for vector of matrix IO
-        VecMatrixf cqtHarmonic(const Vectorf& x, bool batch_norm);
+        VecMatrixf cqtHarmonic(const VectorfRef& x, bool batch_norm) const;
 
         // get the kernel matrix, just for testing
-        Matrixcf getKernel();
+        Matrixcf getKernel() const;
 
         // get the lowpass filter, just for testing
-        Vectorf getFilter();
+        Vectorf getFilter() const;
 
     private:
         
-        // the kernel matrix
+        // the kernel matrix, mapped from the model directory and shared by every CQ using it
         // Eigen::SparseMatrix<std::complex<float>> _kernel;
-        Matrixcf _kernel;
+        std::shared_ptr<const std::complex<float>> _kernel;
+        int _kernel_rows;
+        int _kernel_cols;
+
+        Eigen::Map<const Matrixcf> kernel() const { return Eigen::Map<const Matrixcf>(_kernel.get(), _kernel_rows, _kernel_cols); }
         
         CQParams params;
 
@@ -61,8 +70,8 @@ class CQ {
         Vectorf _filter_kernel;
 
         // compute the cqt for input audio
-        Matrixcf forward( const Vectorf& x, int hop_length );
+        Matrixcf forward( const VectorfRef& x, int hop_length ) const;
 
         // harmonic stacking
-        VecMatrixf harmonicStacking(const Matrixf& cqt , int bins_per_semitone, std::vector<float> harmonics, int n_output_freqs);
+        VecMatrixf harmonicStacking(const Matrixf& cqt , int bins_per_semitone, std::vector<float> harmonics, int n_output_freqs) const;
 };  
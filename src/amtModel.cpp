@@ -1,80 +1,159 @@
 #include "amtModel.h"
 #include "utils.h"
+#include "nnUtils.h"
 #include <iostream>
 
 // #define USE_OMP
-#define USE_PTHREADS
+// #define USE_PTHREADS
+#define USE_TASK_GRAPH
 
 #ifdef USE_OMP
 #include <omp.h>
 #endif
 
-#define USE_PTHREADS
 #ifdef USE_PTHREADS
 // #include <pthread.h>
 #include <thread>
 #endif
 
+// inferenceGraph is always built, USE_TASK_GRAPH only selects it for transcribeAudio
+#include "taskGraph.h"
+#include "boundedQueue.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+
+// adaptive policy: with at least one window per thread, every window runs on one thread
+// (inter-window parallelism), otherwise the threads are shared out among the windows and
+// each layer / CQT splits its work over them (intra-window parallelism)
+inline int intraWindowThreads( int n_windows, int n_threads ) {
+    if ( n_windows >= n_threads )
+        return 1;
+    return std::max(1, n_threads / std::max(1, n_windows));
+}
+
 amtModel::amtModel(): 
-    _cqt(),
-    _onset_input_cnn("Onset Input"),
-    _onset_output_cnn("Onset Output"),
-    _note_cnn("Note"),
-    _contour_cnn("Contour") {
+    amtModel(amtWeights::shared()) {
+}
+
+amtModel::amtModel( const ModelConfig& config ):
+    amtModel(amtWeights::shared(config)) {
+}
+
+amtModel::amtModel( std::shared_ptr<const amtWeights> weights, std::shared_ptr<ThreadPool> pool ):
+    _weights(weights),
+    _pool(pool ? pool : ThreadPool::shared()) {
 
-#if defined USE_OMP || defined USE_PTHREADS
+#if defined USE_OMP || defined USE_PTHREADS || defined USE_TASK_GRAPH
     Eigen::initParallel();
 #endif
 
 }
 
+amtModel::amtModel( std::shared_ptr<ModelHandle> handle, std::shared_ptr<ThreadPool> pool ):
+    amtModel(handle->get(), pool) {
+    _handle = handle;
+}
+
+void amtModel::pinWeights() {
+    if ( _handle )
+        _weights = _handle->get();
+}
+
 void amtModel::reset() {
     _audio_len = 0;
-    _Yp_buffer.clear();
-    _Yn_buffer.clear();
-    _Yo_buffer.clear();
+    _Yp.resize(0, N_BINS_CONTOUR);
+    _Yn.resize(0, N_BINS_NOTE);
+    _Yo.resize(0, N_BINS_NOTE);
+}
+
+void amtModel::allocateOutputs( int audio_len ) {
+    _audio_len = audio_len;
+    const int n_frames = getNumFrames(audio_len);
+    _Yp.resize(n_frames, N_BINS_CONTOUR);
+    _Yn.resize(n_frames, N_BINS_NOTE);
+    _Yo.resize(n_frames, N_BINS_NOTE);
+}
+
+void amtModel::storeWindow( int idx, const Matrixf& Yp, const Matrixf& Yn, const Matrixf& Yo ) {
+    writeWindowFrames(_Yp, Yp, idx);
+    writeWindowFrames(_Yn, Yn, idx);
+    writeWindowFrames(_Yo, Yo, idx);
 }
 
 std::vector<Note> amtModel::transcribeAudio( const Vectorf& audio ) {
 
     // reset the model
     reset();
+    pinWeights();
 
-    _audio_len = audio.size();
-    auto audio_windowed = getWindowedAudio(audio);
-    
+    if ( !_cache ) {
+        inferenceAudio(audio);
+        return buffers2Notes();
+    }
+
+    // a transcription of the same samples by the same weights
+    const CacheKey key = TranscriptionCache::key(audio, _weights->fingerprint(), _notes_only);
+    NoteArray notes;
+    if ( _cache->load(key, _Yp, _Yn, _Yo, notes) ) {
+        _audio_len = audio.size();
+        return notes.toNotes();
+    }
+
+    inferenceAudio(audio);
+    {
+        ScopedIntraOpThreads decode_threads(_pool->size());
+        notes = modelOutput2NoteArray(_Yp, _Yn, _Yo, true, true, _notes_only);
+    }
+    _cache->store(key, _Yp, _Yn, _Yo, notes);
+    return notes.toNotes();
+}
+
+std::vector<Note> amtModel::decode( float onset_threshold, float frame_threshold, int min_note_length ) const {
+    // the decoder runs on the calling thread, with the threads of the pool
+    ScopedIntraOpThreads decode_threads(_pool->size());
+    return modelOutput2Notes(_Yp, _Yn, _Yo, true, true, _notes_only, onset_threshold, frame_threshold, min_note_length);
+}
+
+void amtModel::inferenceAudio( const Vectorf& audio ) {
+
+    // every window writes its frames straight into the full posteriorgrams
+    allocateOutputs(audio.size());
+
+    if ( _pipeline_config.enabled ) {
+        inferencePipeline(audio);
+        return;
+    }
+
+    // windows are views into one padded copy of the audio
+    WindowedAudio audio_windowed(audio);
 
 #ifdef USE_OMP
-    // reserve buffer size
-    _Yp_buffer.resize(audio_windowed.size());
-    _Yn_buffer.resize(audio_windowed.size());
-    _Yo_buffer.resize(audio_windowed.size());
 #pragma omp parallel for
     for ( int i = 0 ; i < audio_windowed.size() ; i++ ) {
-        // inferenceFrame(audio_windowed[i]);
-        VecMatrixf cqt = _cqt.cqtHarmonic(audio_windowed[i], true);
-        VecMatrixf contour_out = _contour_cnn.forward(cqt);
-        _Yp_buffer[i] = contour_out[0]; // Yp
-        VecMatrixf note_out = _note_cnn.forward(contour_out);
-        _Yn_buffer[i] = note_out[0]; // Yn
+        // inferenceFrame(audio_windowed.window(i));
+        VecMatrixf cqt = _weights->cqt().cqtHarmonic(audio_windowed.window(i), true);
+        VecMatrixf contour_out = _weights->contourCNN().forward(cqt);
+        writeWindowFrames(_Yp, contour_out[0], i); // Yp
+        VecMatrixf note_out = _weights->noteCNN().forward(contour_out);
+        writeWindowFrames(_Yn, note_out[0], i); // Yn
         VecMatrixf concat_buf = {note_out[0]};
-        VecMatrixf onset_out = _onset_input_cnn.forward(cqt);
+        VecMatrixf onset_out = _weights->onsetInputCNN().forward(cqt);
         concat_buf.insert(concat_buf.end(), onset_out.begin(), onset_out.end());
-        VecMatrixf concat_out = _onset_output_cnn.forward(concat_buf);
-        _Yo_buffer[i] = concat_out[0]; // Yo
+        VecMatrixf concat_out = _weights->onsetOutputCNN().forward(concat_buf, _notes_only);
+        writeWindowFrames(_Yo, concat_out[0], i); // Yo
     }
+#elif defined USE_TASK_GRAPH
+    inferenceGraph(audio_windowed);
 #elif defined USE_PTHREADS
-    // reserve buffer size
-    _Yp_buffer.resize(audio_windowed.size());
-    _Yn_buffer.resize(audio_windowed.size());
-    _Yo_buffer.resize(audio_windowed.size());
     const int max_threads = std::getenv("OMP_NUM_THREADS") ? atoi(std::getenv("OMP_NUM_THREADS")) : 1;
     std::vector<std::thread> threads(max_threads);
     for ( int i = 0 ; i < audio_windowed.size() ; ) {
         int used_threads = 0;
         while ( used_threads < max_threads && i < audio_windowed.size() ) {
             PthreadArg* arg = new PthreadArg;
-            arg->audio = &audio_windowed[i];
+            arg->audio = &audio_windowed;
             arg->idx = i;
             threads[used_threads] = std::thread(&amtModel::inferenceFramePthread, this, arg);
             i++;
@@ -87,64 +166,381 @@ std::vector<Note> amtModel::transcribeAudio( const Vectorf& audio ) {
     threads.clear();
 #else
     for ( int i = 0 ; i < audio_windowed.size() ; i++ ) {
-        inferenceFrame(audio_windowed[i]);
+        inferenceFrame(audio_windowed.window(i), i);
     }
 #endif
+}
 
-    // concat 3 buffers
-    Matrixf Yp = concatMatrices(_Yp_buffer, _audio_len);
-    Matrixf Yn = concatMatrices(_Yn_buffer, _audio_len);
-    Matrixf Yo = concatMatrices(_Yo_buffer, _audio_len);
+std::vector<Note> amtModel::buffers2Notes() {
+    // convert to midi note events, on the calling thread with the threads of the pool
+    ScopedIntraOpThreads decode_threads(_pool->size());
+    return modelOutput2Notes(_Yp, _Yn, _Yo, true, true, _notes_only);
+}
 
-    // convert to midi note events
-    return modelOutput2Notes(Yp, Yn, Yo, true);
+std::shared_ptr<TranscriptionJob> amtModel::transcribeAsync( const Vectorf& audio, TranscriptionJob::Callback on_done, int intra_threads ) const {
+    auto job = std::make_shared<TranscriptionJob>(_handle ? _handle->get() : _weights, audio, _notes_only, on_done);
+    if ( intra_threads <= 0 )
+        intra_threads = intraWindowThreads(job->numWindows(), _pool->size());
+    // the tasks own the job, the caller may drop its handle
+    for ( int i = 0 ; i < job->numWindows() ; i++ )
+        _pool->submit([job, i, intra_threads] { job->runWindow(i, intra_threads); });
+    return job;
+}
+
+void amtModel::transcribeStream( AudioReader& reader, const std::function<void(const NoteArray&)>& on_notes, const StreamConfig& config ) {
+
+    reset();
+    pinWeights();
+
+    const int segment_windows = std::max(1, config.segment_windows);
+    const int context_frames = std::max(0, config.context_frames);
+    const int segment_samples = (segment_windows - 1) * WINDOW_HOP_SIZE + AUDIO_N_SAMPLES;
+
+    // padded samples starting at the first window of the next segment
+    Vectorf pending = Vectorf::Zero(OVERLAP_LENGTH / 2);
+    std::vector<float> chunk;
+    int n_samples = 0;
+    bool end_of_stream = false;
+    int first_window = 0;
+    int n_windows = -1; // known at the end of the stream
+
+    // retained posteriorgrams, row 0 is frame frames_start of the stream
+    Matrixf Yp(0, N_BINS_CONTOUR), Yn(0, N_BINS_NOTE), Yo(0, N_BINS_NOTE);
+    int frames_start = 0;
+    // notes starting before this frame were emitted
+    int committed = 0;
+    // end frame of the last note emitted per pitch, a later block can find the tail of such a note again
+    std::vector<int> pitch_end(MIDI_OFFSET + N_BINS_NOTE, 0);
+
+    while ( n_windows < 0 || first_window < n_windows ) {
+
+        while ( !end_of_stream && pending.size() < segment_samples ) {
+            const int n_missing = segment_samples - pending.size();
+            chunk.resize(n_missing);
+            const int n_read = reader.read(chunk.data(), n_missing);
+            if ( n_read <= 0 ) {
+                end_of_stream = true;
+                break;
+            }
+            pending.conservativeResize(pending.size() + n_read);
+            pending.tail(n_read) = Eigen::Map<const Vectorf>(chunk.data(), n_read);
+            n_samples += n_read;
+        }
+
+        int n_segment_windows = segment_windows;
+        int n_segment_frames = segment_windows * WINDOW_OUTPUT_FRAMES;
+        if ( end_of_stream ) {
+            // same zero padding at the end as WindowedAudio
+            n_windows = getNumWindows(n_samples);
+            n_segment_windows = std::min(segment_windows, n_windows - first_window);
+            n_segment_frames = std::max(0, std::min(n_segment_windows * WINDOW_OUTPUT_FRAMES,
+                getNumFrames(n_samples) - first_window * WINDOW_OUTPUT_FRAMES));
+            const int n_padded = (n_segment_windows - 1) * WINDOW_HOP_SIZE + AUDIO_N_SAMPLES;
+            if ( pending.size() < n_padded ) {
+                const int n_zeros = n_padded - pending.size();
+                pending.conservativeResize(n_padded);
+                pending.tail(n_zeros).setZero();
+            }
+        }
+
+        // run the windows of the segment, they write into _Yp, _Yn and _Yo at their index in the segment
+        WindowedAudio segment = WindowedAudio::fromPadded(
+            pending.head((n_segment_windows - 1) * WINDOW_HOP_SIZE + AUDIO_N_SAMPLES));
+        _Yp.resize(n_segment_frames, N_BINS_CONTOUR);
+        _Yn.resize(n_segment_frames, N_BINS_NOTE);
+        _Yo.resize(n_segment_frames, N_BINS_NOTE);
+        inferenceGraph(segment);
+        appendRows(Yp, _Yp);
+        appendRows(Yn, _Yn);
+        appendRows(Yo, _Yo);
+
+        // keep the overlap with the next segment
+        first_window += n_segment_windows;
+        pending = pending.tail(pending.size() - n_segment_windows * WINDOW_HOP_SIZE).eval();
+
+        const bool last_segment = n_windows >= 0 && first_window >= n_windows;
+        const int n_frames = frames_start + Yn.rows();
+        const int commit = last_segment ? n_frames : n_frames - context_frames;
+        if ( commit <= committed )
+            continue;
+
+        NoteArray decoded;
+        {
+            ScopedIntraOpThreads decode_threads(_pool->size());
+            decoded = modelOutput2NoteArray(Yp, Yn, Yo, true, true, _notes_only);
+        }
+        NoteArray emitted;
+        std::vector<int> block_pitch_end(pitch_end);
+        for ( size_t i = 0 ; i < decoded.size() ; i++ ) {
+            const int start = decoded.start_frame[i] + frames_start;
+            const int pitch = decoded.pitch[i];
+            if ( start < committed || start >= commit || start < pitch_end[pitch] )
+                continue;
+            emitted.append(decoded, i, frames_start);
+            block_pitch_end[pitch] = std::max(block_pitch_end[pitch], decoded.end_frame[i] + frames_start);
+        }
+        pitch_end.swap(block_pitch_end);
+        committed = commit;
+
+        if ( emitted.size() > 0 )
+            on_notes(emitted);
+
+        // drop the frames the next block does not need
+        const int new_start = std::max(frames_start, commit - context_frames);
+        const int n_dropped = new_start - frames_start;
+        if ( n_dropped > 0 ) {
+            dropRows(Yp, n_dropped);
+            dropRows(Yn, n_dropped);
+            dropRows(Yo, n_dropped);
+            frames_start = new_start;
+        }
+    }
+
+    reset();
+}
+
+std::vector<Note> amtModel::transcribeStream( AudioReader& reader, const StreamConfig& config ) {
+    std::vector<Note> notes;
+    transcribeStream(reader, [&notes] ( const NoteArray& block ) {
+        for ( size_t i = 0 ; i < block.size() ; i++ )
+            notes.emplace_back(block.at(i));
+    }, config);
+    return notes;
+}
+
+// the CNN part of the model for one window, cqt shape : (n_harmonics, n_frames, n_bins)
+void amtModel::inferenceCNN( const VecMatrixf& cqt, Matrixf& Yp, Matrixf& Yn, Matrixf& Yo ) const {
+    _weights->inferenceCNN(cqt, Yp, Yn, Yo, _notes_only);
+}
+
+// stages connected by bounded queues, each with its own threads:
+// window indexing (1) -> CQT + harmonic stacking (cqt_threads) -> CNNs (cnn_threads) -> assembly (caller)
+// a full queue blocks its producer, so at most queue_capacity windows wait between two stages
+void amtModel::inferencePipeline( const Vectorf& audio ) {
+
+    const int n_windows = getNumWindows(audio.size());
+    const int n_threads = getNumThreads();
+    const int cqt_threads = _pipeline_config.cqt_threads > 0 ?
+        _pipeline_config.cqt_threads : std::max(1, n_threads / 4);
+    const int cnn_threads = _pipeline_config.cnn_threads > 0 ?
+        _pipeline_config.cnn_threads : std::max(1, n_threads - cqt_threads);
+    const size_t queue_capacity = _pipeline_config.queue_capacity > 0 ?
+        _pipeline_config.queue_capacity : 2 * (cqt_threads + cnn_threads);
+
+    struct WindowOutput {
+        int idx;
+        Matrixf Yp, Yn, Yo;
+    };
+    // windows are views into one padded copy of the audio, only their indices are queued
+    const WindowedAudio audio_windowed(audio);
+    BoundedQueue<int> window_queue(queue_capacity);
+    BoundedQueue<std::pair<int, VecMatrixf>> cqt_queue(queue_capacity);
+    BoundedQueue<WindowOutput> output_queue(queue_capacity);
+
+    // the first error closes every queue, which stops all stages
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto fail = [&] {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if ( !error )
+                error = std::current_exception();
+        }
+        window_queue.close();
+        cqt_queue.close();
+        output_queue.close();
+    };
+
+    std::vector<std::thread> threads;
+    std::atomic<int> cqt_running(cqt_threads);
+    std::atomic<int> cnn_running(cnn_threads);
+
+    // an error while starting the stages or in the assembly goes through fail() as well,
+    // so the started stages stop and are joined before it is rethrown
+    try {
+        threads.emplace_back([&] {
+            try {
+                for ( int i = 0 ; i < n_windows ; i++ ) {
+                    if ( !window_queue.push(i) )
+                        break;
+                }
+            }
+            catch (...) { fail(); }
+            window_queue.close();
+        });
+
+        for ( int t = 0 ; t < cqt_threads ; t++ ) {
+            threads.emplace_back([&] {
+                setIntraOpThreads(intraWindowThreads(n_windows, cqt_threads));
+                try {
+                    int idx;
+                    while ( window_queue.pop(idx) ) {
+                        if ( !cqt_queue.push({idx, _weights->cqt().cqtHarmonic(audio_windowed.window(idx), true)}) )
+                            break;
+                    }
+                }
+                catch (...) { fail(); }
+                if ( --cqt_running == 0 )
+                    cqt_queue.close();
+            });
+        }
+
+        for ( int t = 0 ; t < cnn_threads ; t++ ) {
+            threads.emplace_back([&] {
+                setIntraOpThreads(intraWindowThreads(n_windows, cnn_threads));
+                try {
+                    std::pair<int, VecMatrixf> cqt;
+                    while ( cqt_queue.pop(cqt) ) {
+                        WindowOutput output;
+                        output.idx = cqt.first;
+                        inferenceCNN(cqt.second, output.Yp, output.Yn, output.Yo);
+                        if ( !output_queue.push(std::move(output)) )
+                            break;
+                    }
+                }
+                catch (...) { fail(); }
+                if ( --cnn_running == 0 )
+                    output_queue.close();
+            });
+        }
+
+        // assembly, windows may arrive out of order
+        WindowOutput output;
+        while ( output_queue.pop(output) ) {
+            storeWindow(output.idx, output.Yp, output.Yn, output.Yo);
+        }
+    }
+    catch (...) { fail(); }
+
+    for ( auto& thread : threads )
+        thread.join();
+
+    if ( error )
+        std::rethrow_exception(error);
 }
 
 // input shape : (N_AUDIO_SAMPLES, N_BIN_CONTORU )
-void amtModel::inferenceFrame( const Vectorf& x ) {
+void amtModel::inferenceFrame( const VectorfRef& x, int idx ) {
     VecMatrixf output;
 
     // compute harmonic stacking, shape : (n_harmonics, n_frames, n_bins)
-    VecMatrixf cqt = _cqt.cqtHarmonic(x, true);
+    VecMatrixf cqt = _weights->cqt().cqtHarmonic(x, true);
 
-    VecMatrixf contour_out = _contour_cnn.forward(cqt);
-    _Yp_buffer.push_back(contour_out[0]); // Yp
+    VecMatrixf contour_out = _weights->contourCNN().forward(cqt);
+    writeWindowFrames(_Yp, contour_out[0], idx); // Yp
 
-    VecMatrixf note_out = _note_cnn.forward(contour_out);
-    _Yn_buffer.push_back(note_out[0]); // Yn
+    VecMatrixf note_out = _weights->noteCNN().forward(contour_out);
+    writeWindowFrames(_Yn, note_out[0], idx); // Yn
 
     VecMatrixf concat_buf = {note_out[0]};
-    VecMatrixf onset_out = _onset_input_cnn.forward(cqt);
+    VecMatrixf onset_out = _weights->onsetInputCNN().forward(cqt);
     concat_buf.insert(concat_buf.end(), onset_out.begin(), onset_out.end());
 
-    VecMatrixf concat_out = _onset_output_cnn.forward(concat_buf);
-    _Yo_buffer.push_back(concat_out[0]); // Yo
+    VecMatrixf concat_out = _weights->onsetOutputCNN().forward(concat_buf, _notes_only);
+    writeWindowFrames(_Yo, concat_out[0], idx); // Yo
 
 }
 
 void amtModel::inferenceFramePthread( PthreadArg* arg ) {
     size_t idx = arg->idx;
     // compute harmonic stacking, shape : (n_harmonics, n_frames, n_bins)
-    VecMatrixf cqt = _cqt.cqtHarmonic(*(arg->audio), true);
+    VecMatrixf cqt = _weights->cqt().cqtHarmonic(arg->audio->window(idx), true);
 
-    VecMatrixf contour_out = _contour_cnn.forward(cqt);
-    _Yp_buffer[idx] = contour_out[0]; // Yp
+    VecMatrixf contour_out = _weights->contourCNN().forward(cqt);
+    writeWindowFrames(_Yp, contour_out[0], idx); // Yp
 
-    VecMatrixf note_out = _note_cnn.forward(contour_out);
-    _Yn_buffer[idx] = note_out[0]; // Yn
+    VecMatrixf note_out = _weights->noteCNN().forward(contour_out);
+    writeWindowFrames(_Yn, note_out[0], idx); // Yn
 
     VecMatrixf concat_buf = {note_out[0]};
-    VecMatrixf onset_out = _onset_input_cnn.forward(cqt);
+    VecMatrixf onset_out = _weights->onsetInputCNN().forward(cqt);
     concat_buf.insert(concat_buf.end(), onset_out.begin(), onset_out.end());
 
-    VecMatrixf concat_out = _onset_output_cnn.forward(concat_buf);
-    _Yo_buffer[idx] = concat_out[0]; // Yo
+    VecMatrixf concat_out = _weights->onsetOutputCNN().forward(concat_buf, _notes_only);
+    writeWindowFrames(_Yo, concat_out[0], idx); // Yo
+}
+
+// the model as a dataflow graph per window:
+// CQT -> Contour -> Note ------> Concat -> Onset Output
+//    \-> Onset Input ----------/
+// all windows go into one graph, so independent nodes of the same window
+// (Contour/Note vs. Onset Input) and of different windows run concurrently on _pool
+// the CQT of a window waits for the Onset Output of the window max_in_flight before it,
+// so the intermediate results of at most max_in_flight windows are alive at once, and
+// window i reuses the buffers of window i - max_in_flight
+void amtModel::inferenceGraph( const WindowedAudio& audio_windowed ) {
+
+    // intermediate results of one window, the CNN outputs keep their memory for the next window
+    // of the slot (see CNN::forward), only the CQT is allocated per window
+    struct WindowState {
+        VecMatrixf cqt;
+        VecMatrixf contour_out;
+        VecMatrixf note_out;
+        VecMatrixf onset_out;
+        VecMatrixf concat_buf;
+        VecMatrixf concat_out;
+    };
+
+    const int n_windows = audio_windowed.size();
+    const int intra_threads = intraWindowThreads(n_windows, _pool->size());
+    const int max_in_flight = 2 * _pool->size();
+    std::vector<WindowState> states(std::min(n_windows, max_in_flight));
+    std::vector<int> output_nodes(n_windows);
+
+    TaskGraph graph;
+    for ( int i = 0 ; i < n_windows ; i++ ) {
+        WindowState& st = states[i % max_in_flight];
+        const std::string suffix = " " + std::to_string(i);
+        std::vector<int> cqt_deps;
+        if ( i >= max_in_flight )
+            cqt_deps.push_back(output_nodes[i - max_in_flight]);
+
+        // compute harmonic stacking, shape : (n_harmonics, n_frames, n_bins)
+        int cqt_node = graph.addNode("CQT" + suffix, [this, &st, &audio_windowed, i, intra_threads] {
+            setIntraOpThreads(intra_threads);
+            st.cqt = _weights->cqt().cqtHarmonic(audio_windowed.window(i), true);
+        }, cqt_deps);
+
+        int contour_node = graph.addNode("Contour" + suffix, [this, &st, i, intra_threads] {
+            setIntraOpThreads(intra_threads);
+            _weights->contourCNN().forward(st.cqt, st.contour_out);
+            writeWindowFrames(_Yp, st.contour_out[0], i); // Yp
+        }, {cqt_node});
+
+        int note_node = graph.addNode("Note" + suffix, [this, &st, i, intra_threads] {
+            setIntraOpThreads(intra_threads);
+            _weights->noteCNN().forward(st.contour_out, st.note_out);
+            writeWindowFrames(_Yn, st.note_out[0], i); // Yn
+        }, {contour_node});
+
+        int onset_input_node = graph.addNode("Onset Input" + suffix, [this, &st, intra_threads] {
+            setIntraOpThreads(intra_threads);
+            _weights->onsetInputCNN().forward(st.cqt, st.onset_out);
+        }, {cqt_node});
+
+        // channels are swapped, not copied, into the concat buffer, so both sides keep a buffer
+        int concat_node = graph.addNode("Concat" + suffix, [&st] {
+            st.concat_buf.resize(1 + st.onset_out.size());
+            st.concat_buf[0].swap(st.note_out[0]);
+            for ( size_t k = 0 ; k < st.onset_out.size() ; k++ )
+                st.concat_buf[k + 1].swap(st.onset_out[k]);
+        }, {note_node, onset_input_node});
+
+        output_nodes[i] = graph.addNode("Onset Output" + suffix, [this, &st, i, intra_threads] {
+            setIntraOpThreads(intra_threads);
+            _weights->onsetOutputCNN().forward(st.concat_buf, st.concat_out, _notes_only);
+            writeWindowFrames(_Yo, st.concat_out[0], i); // Yo
+        }, {concat_node});
+    }
+
+    // the calling thread runs nodes too, with the budget of the pool threads
+    ScopedIntraOpThreads caller_threads(intra_threads);
+    graph.run(*_pool);
 }
 
 VecMatrixf amtModel::getOutput() {
-    // concat 3 buffers
-    Matrixf Yp = concatMatrices(_Yp_buffer, _audio_len);
-    Matrixf Yn = concatMatrices(_Yn_buffer, _audio_len);
-    Matrixf Yo = concatMatrices(_Yo_buffer, _audio_len);
-    return {Yp, Yn, Yo};
+    // the final sigmoid was skipped in notes-only mode, apply it to a copy
+    if ( _notes_only )
+        return {_Yp, _Yn, Sigmoid().forward({_Yo})[0]};
+    return {_Yp, _Yn, _Yo};
 }
\ No newline at end of file
@@ -4,60 +4,176 @@
 #include "CQT.h"
 #include "cnn.h"
 #include "note.h"
+#include "threadPool.h"
+#include "amtWeights.h"
+#include "utils.h"
+#include "audioReader.h"
+#include "transcriptionJob.h"
+#include "modelHandle.h"
+#include "transcriptionCache.h"
+#include <memory>
+#include <functional>
 
 struct PthreadArg {
-    const Vectorf* audio;
+    const WindowedAudio* audio;
     int idx;
 };
 
+// thread budget of the pipelined mode, 0 derives the value from getNumThreads()
+struct PipelineConfig {
+    bool enabled = false;
+    int cqt_threads = 0;
+    int cnn_threads = 0;
+    int queue_capacity = 0; // max windows waiting between two stages
+};
+
+// streaming mode: windows run one segment at a time and the decoder runs after every segment
+// on the frames it retains. notes starting more than context_frames before the newest frame are
+// emitted, frames more than context_frames before that are dropped, so memory does not grow
+// with the duration. onsets are normalized per decoded block instead of over the whole signal,
+// results equal transcribeAudio when the signal fits into one block
+struct StreamConfig {
+    int segment_windows = 16;
+    int context_frames = 10 * ANNOTATIONS_FPS;
+};
+
+// a transcription session: per-request buffers on top of shared, immutable weights
+// one session runs one transcribeAudio at a time, concurrent requests use one session each
 class amtModel {
     public:
 
+        // weights and worker pool shared by the process (see amtWeights::shared and ThreadPool::shared)
         amtModel();
 
+        // weights of config.model_dir and the worker pool shared by the process
+        amtModel( const ModelConfig& config );
+
+        // share weights with other sessions, the pool defaults to the one of the process,
+        // pass a pool of its own to isolate the session
+        amtModel( std::shared_ptr<const amtWeights> weights, std::shared_ptr<ThreadPool> pool = nullptr );
+
+        // follow the current version of handle: every transcription runs on the weights
+        // current when it started, also when a new version is swapped in meanwhile
+        amtModel( std::shared_ptr<ModelHandle> handle, std::shared_ptr<ThreadPool> pool = nullptr );
+
         ~amtModel() = default;
 
         // reset the model
         void reset();
 
+        // notes-only mode: the onset output CNN skips its final sigmoid and the
+        // decoder thresholds the onset logits instead
+        void setNotesOnly( bool notes_only ) { _notes_only = notes_only; }
+
+        // pipelined mode: slicing, CQT and CNN stages of consecutive windows overlap
+        void setPipelineConfig( const PipelineConfig& config ) { _pipeline_config = config; }
+
+        // consult cache in transcribeAudio before doing any work and store every new transcription
+        // in it, null disables the cache. the cache may be shared by any number of sessions
+        void setCache( std::shared_ptr<TranscriptionCache> cache ) { _cache = cache; }
+
+        std::shared_ptr<TranscriptionCache> getCache() const { return _cache; }
+
+        bool notesOnly() const { return _notes_only; }
+
         // transcriibe audio
+        // blocks until the windows are done, the calling thread runs windows of the task graph
+        // while it waits, so it may also be a thread of the pool, e.g. in a transcribeAsync callback
         std::vector<Note> transcribeAudio( const Vectorf& audio );
 
+        // decode the posteriorgrams of the last transcription again, e.g. with other thresholds
+        std::vector<Note> decode( float onset_threshold = ONSET_THRESHOLD, float frame_threshold = FRAME_THRESHOLD,
+            int min_note_length = MIN_NOTE_LENGTH ) const;
+
+        // enqueue the transcription of audio on the worker pool and return at once, the job copies
+        // audio and keeps the weights alive, so neither audio nor this session have to outlive it.
+        // the pool must outlive the job, on_done runs on a pool thread. intra_threads are the threads
+        // of every window, 0 spreads the pool over the windows of this job alone.
+        // the windows of the job only run on the pool, so do not wait for it on a thread of the pool.
+        // the job bypasses the cache of the session, callers wanting it look the audio up before and store
+        // the posteriorgrams of the job in on_done, like transcribeBatch does
+        std::shared_ptr<TranscriptionJob> transcribeAsync( const Vectorf& audio, TranscriptionJob::Callback on_done = nullptr,
+            int intra_threads = 0 ) const;
+
+        // transcribe audio pulled from reader, on_notes receives the notes of every decoded block
+        // with frames and times relative to the start of the stream
+        void transcribeStream( AudioReader& reader, const std::function<void(const NoteArray&)>& on_notes,
+            const StreamConfig& config = StreamConfig() );
+
+        std::vector<Note> transcribeStream( AudioReader& reader, const StreamConfig& config = StreamConfig() );
+
         // inference API for Eigen IO
-        void inferenceFrame( const Vectorf& x );
+        // run one window and write its frames at window index idx
+        void inferenceFrame( const VectorfRef& x, int idx );
 
         void inferenceFramePthread( PthreadArg* arg );
 
+        // run all windows through the model as one task graph on the shared pool
+        void inferenceGraph( const WindowedAudio& audio_windowed );
+
+        // run all windows through the stage pipeline
+        void inferencePipeline( const Vectorf& audio );
+
         // get the CQ object, just for testing
-        CQ getCQ() { return _cqt; }
+        CQ getCQ() { return _weights->cqt(); }
+
+        // weights of the last transcription, or the current ones of the handle before the first
+        std::shared_ptr<const amtWeights> getWeights() const { return _weights; }
+
+        std::shared_ptr<ModelHandle> getHandle() const { return _handle; }
+
+        std::shared_ptr<ThreadPool> getPool() const { return _pool; }
 
-        // get the buffer for Yp, Yn, Yo
-        VecVecMatrixf getBuffer() { return {_Yp_buffer, _Yn_buffer, _Yo_buffer};}
+        // views of the posteriorgrams of the last transcription, Yo holds logits in notes-only mode
+        const Matrixf& getYp() const { return _Yp; }
+        const Matrixf& getYn() const { return _Yn; }
+        const Matrixf& getYo() const { return _Yo; }
 
+        // copies of Yp, Yn and Yo with Yo as probabilities
         VecMatrixf getOutput();
 
     private:
 
-        // CQ for generating features
-        CQ _cqt;
+        // take the current weights of the handle for the next transcription
+        void pinWeights();
+
+        void inferenceCNN( const VecMatrixf& cqt, Matrixf& Yp, Matrixf& Yn, Matrixf& Yo ) const;
+
+        // fill the posteriorgrams of audio
+        void inferenceAudio( const Vectorf& audio );
+
+        // decode the posteriorgrams into notes
+        std::vector<Note> buffers2Notes();
+
+        // size the posteriorgrams for audio_len samples
+        void allocateOutputs( int audio_len );
+
+        // write the trimmed frames of one window into the posteriorgrams
+        void storeWindow( int idx, const Matrixf& Yp, const Matrixf& Yn, const Matrixf& Yo );
+
+        // weights shared between sessions, fixed for the duration of a transcription
+        std::shared_ptr<const amtWeights> _weights;
+
+        // source of _weights for sessions following a ModelHandle, null otherwise
+        std::shared_ptr<ModelHandle> _handle;
 
+        // shared worker pool for the task graph
+        std::shared_ptr<ThreadPool> _pool;
 
-        // CNN for onset detection
-        CNN _onset_input_cnn;
-        CNN _onset_output_cnn;
+        // transcriptions by content, null when disabled
+        std::shared_ptr<TranscriptionCache> _cache;
 
-        // CNN for note detection
-        CNN _note_cnn;
+        // full length posteriorgrams, windows write their frames at idx * WINDOW_OUTPUT_FRAMES
+        Matrixf _Yp;
+        Matrixf _Yn;
+        Matrixf _Yo;
 
-        // CNN for contour detection
-        CNN _contour_cnn;
+        int _audio_len = 0;
 
-        // Buffer for Yp, Yn, Yo
-        VecMatrixf _Yp_buffer;
-        VecMatrixf _Yn_buffer;
-        VecMatrixf _Yo_buffer;
+        // Yo buffer holds logits instead of probabilities
+        bool _notes_only = false;
 
-        int _audio_len;
+        PipelineConfig _pipeline_config;
 };
 
 
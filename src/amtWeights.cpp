@@ -0,0 +1,126 @@
+#include "amtWeights.h"
+#include "hash.h"
+#include "loader.h"
+#include <future>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// the named model of model_dir, an error names the missing model file
+inline CNN* loadCNN( const std::string& model_name, const std::string& model_dir ) {
+    std::vector<Layer*> layers;
+    try {
+        getLayers(layers, model_name, model_dir);
+    }
+    catch (...) {
+        for ( Layer* layer : layers )
+            delete layer;
+        throw;
+    }
+    return new CNN(model_name, std::move(layers));
+}
+
+amtWeights::amtWeights( const ModelConfig& config ):
+    _config(config),
+    _cqt([dir = config.model_dir] { return new CQ(dir); }),
+    _onset_input_cnn([dir = config.model_dir] { return loadCNN("Onset Input", dir); }),
+    _onset_output_cnn([dir = config.model_dir] { return loadCNN("Onset Output", dir); }),
+    _note_cnn([dir = config.model_dir] { return loadCNN("Note", dir); }),
+    _contour_cnn([dir = config.model_dir] { return loadCNN("Contour", dir); }),
+    _fingerprint([this] { return new uint64_t(computeFingerprint()); }) {
+
+    if ( _config.lazy )
+        return;
+
+    std::vector<std::function<void()>> loads = {
+        [this] { cqt(); },
+        [this] { onsetInputCNN(); },
+        [this] { onsetOutputCNN(); },
+        [this] { noteCNN(); },
+        [this] { contourCNN(); },
+    };
+    if ( !_config.parallel ) {
+        for ( auto& load : loads )
+            load();
+        return;
+    }
+
+    // the parts are independent, get() rethrows the first load error
+    std::vector<std::future<void>> pending;
+    for ( auto& load : loads )
+        pending.push_back(std::async(std::launch::async, load));
+    for ( auto& f : pending )
+        f.wait();
+    for ( auto& f : pending )
+        f.get();
+}
+
+std::shared_ptr<const amtWeights> amtWeights::shared( const ModelConfig& config ) {
+    static std::mutex mutex;
+    // keyed by the whole config, weights loaded eagerly are not handed to a lazy caller
+    static std::map<std::tuple<std::string, bool, bool>, std::weak_ptr<const amtWeights>> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::weak_ptr<const amtWeights>& entry = cache[{config.model_dir, config.parallel, config.lazy}];
+    std::shared_ptr<const amtWeights> weights = entry.lock();
+    if ( !weights ) {
+        weights = std::make_shared<const amtWeights>(config);
+        entry = weights;
+    }
+    return weights;
+}
+
+inline uint64_t hashFloats( const std::vector<float>& values, uint64_t seed ) {
+    return hash64(values.data(), values.size() * sizeof(float), seed);
+}
+
+uint64_t amtWeights::computeFingerprint() const {
+    const Matrixcf kernel = cqt().getKernel();
+    const Vectorf filter = cqt().getFilter();
+    uint64_t hash = hash64(kernel.data(), kernel.size() * sizeof(std::complex<float>));
+    hash = hash64(filter.data(), filter.size() * sizeof(float), hash);
+
+    for ( const CNN* cnn : { &contourCNN(), &noteCNN(), &onsetInputCNN(), &onsetOutputCNN() } ) {
+        for ( const Layer* layer : cnn->get_layers() ) {
+            hash = hash64(&layer->type, sizeof(layer->type), hash);
+            if ( const Conv2D* conv = dynamic_cast<const Conv2D*>(layer) ) {
+                const int shape[6] = { conv->nFiltersIn(), conv->nFiltersOut(), conv->nFeaturesIn(),
+                    conv->kernelSizeTime(), conv->kernelSizeFeature(), conv->stride() };
+                hash = hash64(shape, sizeof(shape), hash);
+                hash = hash64(conv->kernelData(), conv->kernelSize() * sizeof(float), hash);
+                hash = hash64(conv->bias().data(), conv->bias().size() * sizeof(float), hash);
+            }
+            else if ( const BatchNorm* bn = dynamic_cast<const BatchNorm*>(layer) ) {
+                hash = hashFloats(bn->gamma(), hash);
+                hash = hashFloats(bn->beta(), hash);
+                hash = hashFloats(bn->mean(), hash);
+                hash = hashFloats(bn->variance(), hash);
+            }
+        }
+    }
+    return hash;
+}
+
+void amtWeights::inferenceCNN( const VecMatrixf& cqt, Matrixf& Yp, Matrixf& Yn, Matrixf& Yo, bool skip_onset_sigmoid ) const {
+    VecMatrixf contour_out = contourCNN().forward(cqt);
+    Yp = contour_out[0];
+
+    VecMatrixf note_out = noteCNN().forward(contour_out);
+    Yn = note_out[0];
+
+    VecMatrixf onset_out = onsetInputCNN().forward(cqt);
+    VecMatrixf concat_buf;
+    concat_buf.reserve(1 + onset_out.size());
+    concat_buf.push_back(std::move(note_out[0]));
+    for ( Matrixf& m : onset_out )
+        concat_buf.push_back(std::move(m));
+
+    VecMatrixf concat_out = onsetOutputCNN().forward(concat_buf, skip_onset_sigmoid);
+    Yo = std::move(concat_out[0]);
+}
+
+void amtWeights::inferenceWindow( const VectorfRef& x, Matrixf& Yp, Matrixf& Yn, Matrixf& Yo, bool skip_onset_sigmoid ) const {
+    // compute harmonic stacking, shape : (n_harmonics, n_frames, n_bins)
+    VecMatrixf cqt = this->cqt().cqtHarmonic(x, true);
+    inferenceCNN(cqt, Yp, Yn, Yo, skip_onset_sigmoid);
+}
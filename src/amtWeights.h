@@ -0,0 +1,103 @@
+#pragma once
+
+#include "CQT.h"
+#include "cnn.h"
+#include "constant.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// where and how amtWeights loads the model
+struct ModelConfig {
+    // directory of the CQT kernels and the CNN model files
+    std::string model_dir = DEFAULT_MODEL_DIR;
+    // load the CQT kernels and the four CNNs concurrently
+    bool parallel = true;
+    // load every part on its first use instead of in the constructor, e.g. to skip the
+    // branches a deployment never runs
+    bool lazy = false;
+};
+
+// immutable part of the model: CQT kernels and the weights of the four CNNs
+// loaded once and shared (read only) by any number of amtModel sessions
+// the CQT kernel and the binary model files are mapped, so processes loading the same
+// model directory share one physical copy of them
+class amtWeights {
+    public:
+
+        amtWeights( const ModelConfig& config = ModelConfig() );
+
+        // weights of config shared by the whole process, loaded when no session holds them
+        // configs differing in any field get their own instance
+        static std::shared_ptr<const amtWeights> shared( const ModelConfig& config = ModelConfig() );
+
+        ~amtWeights() = default;
+
+        amtWeights( const amtWeights& ) = delete;
+        amtWeights& operator=( const amtWeights& ) = delete;
+
+        const ModelConfig& config() const { return _config; }
+
+        // the accessors load the part first when the weights are lazy, load errors are thrown here
+        const CQ& cqt() const { return _cqt.get(); }
+
+        const CNN& onsetInputCNN() const { return _onset_input_cnn.get(); }
+
+        const CNN& onsetOutputCNN() const { return _onset_output_cnn.get(); }
+
+        const CNN& noteCNN() const { return _note_cnn.get(); }
+
+        const CNN& contourCNN() const { return _contour_cnn.get(); }
+
+        // hash of every weight of the CQT and the CNNs, the same for the json, binary and embedded
+        // models, computed on the first call (loading lazy parts)
+        uint64_t fingerprint() const { return _fingerprint.get(); }
+
+        // the four CNNs on the harmonic CQT of one window, skip_onset_sigmoid leaves Yo as logits
+        void inferenceCNN( const VecMatrixf& cqt, Matrixf& Yp, Matrixf& Yn, Matrixf& Yo, bool skip_onset_sigmoid ) const;
+
+        // CQT and CNNs of one window of AUDIO_N_SAMPLES samples
+        void inferenceWindow( const VectorfRef& x, Matrixf& Yp, Matrixf& Yn, Matrixf& Yo, bool skip_onset_sigmoid ) const;
+
+    private:
+
+        // a part loaded exactly once on the first get(), from any thread; a failed load is retried by the next get()
+        template <typename T>
+        class LazyPart {
+            public:
+
+                LazyPart( std::function<T*()> load ) : _load(load) {}
+
+                const T& get() const {
+                    std::call_once(_once, [this] { _value.reset(_load()); });
+                    return *_value;
+                }
+
+            private:
+
+                std::function<T*()> _load;
+                mutable std::once_flag _once;
+                mutable std::unique_ptr<T> _value;
+        };
+
+        ModelConfig _config;
+
+        // CQ for generating features
+        LazyPart<CQ> _cqt;
+
+        // CNN for onset detection
+        LazyPart<CNN> _onset_input_cnn;
+        LazyPart<CNN> _onset_output_cnn;
+
+        // CNN for note detection
+        LazyPart<CNN> _note_cnn;
+
+        // CNN for contour detection
+        LazyPart<CNN> _contour_cnn;
+
+        LazyPart<uint64_t> _fingerprint;
+
+        uint64_t computeFingerprint() const;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "typedef.h"
+#include <algorithm>
+
+// pull based mono audio source at SAMPLE_RATE for the streaming transcription
+class AudioReader {
+    public:
+
+        virtual ~AudioReader() = default;
+
+        // copy up to n_samples samples into dst, returns the number copied, 0 at the end of the stream
+        virtual int read( float* dst, int n_samples ) = 0;
+};
+
+// reads an in-memory signal, the signal must outlive the reader
+class VectorfReader : public AudioReader {
+    public:
+
+        VectorfReader( const Vectorf& audio ) : _audio(audio) {}
+
+        int read( float* dst, int n_samples ) override {
+            int n = std::min( n_samples, static_cast<int>(_audio.size()) - _pos );
+            std::copy( _audio.data() + _pos, _audio.data() + _pos + n, dst );
+            _pos += n;
+            return n;
+        }
+
+    private:
+
+        const Vectorf& _audio;
+        int _pos = 0;
+};
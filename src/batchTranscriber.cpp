@@ -0,0 +1,200 @@
+#include "batchTranscriber.h"
+#include "wavReader.h"
+#include "midi.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+inline bool isWavFile( const fs::path& path ) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".wav";
+}
+
+std::vector<std::string> collectInputFiles( const std::vector<std::string>& inputs ) {
+    std::vector<std::string> files;
+    for ( const std::string& input : inputs ) {
+        if ( !input.empty() && input[0] == '@' ) {
+            std::ifstream list(input.substr(1));
+            if ( !list )
+                throw std::runtime_error("cannot open file list " + input.substr(1));
+            std::string line;
+            while ( std::getline(list, line) ) {
+                line.erase(line.find_last_not_of(" \t\r") + 1);
+                if ( !line.empty() && line[0] != '#' )
+                    files.push_back(line);
+            }
+        }
+        else if ( fs::is_directory(input) ) {
+            std::vector<std::string> found;
+            for ( const fs::directory_entry& entry : fs::recursive_directory_iterator(input) )
+                if ( entry.is_regular_file() && isWavFile(entry.path()) )
+                    found.push_back(entry.path().string());
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        }
+        else {
+            files.push_back(input);
+        }
+    }
+    return files;
+}
+
+std::string batchOutputPath( const std::string& input, const std::string& output_dir, const std::string& extension ) {
+    fs::path path(input);
+    path.replace_extension(extension);
+    if ( !output_dir.empty() )
+        path = fs::path(output_dir) / path.filename();
+    return path.string();
+}
+
+std::vector<BatchResult> transcribeBatch( const amtModel& model, const std::vector<std::string>& paths,
+    const BatchConfig& config, const std::function<void(const BatchResult&)>& on_result ) {
+
+    typedef std::chrono::steady_clock Clock;
+    std::shared_ptr<ThreadPool> pool = model.getPool();
+    const int max_in_flight = config.max_in_flight > 0 ? config.max_in_flight : 2 * pool->size();
+    if ( !config.output_dir.empty() )
+        fs::create_directories(config.output_dir);
+
+    std::vector<BatchResult> results(paths.size());
+    std::mutex mutex;
+    std::condition_variable cv;
+    int n_in_flight = 0;
+    size_t n_submitted = 0;
+
+    // a throwing on_result is logged, the file still counts as finished
+    auto report = [&] ( size_t idx ) {
+        if ( !on_result )
+            return;
+        try {
+            on_result(results[idx]);
+        }
+        catch ( const std::exception& e ) {
+            std::cerr << "on_result of " << results[idx].path << " failed: " << e.what() << std::endl;
+        }
+        catch (...) {
+            std::cerr << "on_result of " << results[idx].path << " failed" << std::endl;
+        }
+    };
+
+    // called once per file from a pool thread
+    auto finish = [&] ( size_t idx, Clock::time_point start ) {
+        results[idx].wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(mutex);
+        report(idx);
+        n_in_flight--;
+        cv.notify_all();
+    };
+
+    // write the outputs of a transcribed file
+    auto complete = [&] ( size_t idx, Clock::time_point start, const NoteArray& notes ) {
+        BatchResult& result = results[idx];
+        result.n_notes = notes.size();
+        try {
+            if ( config.write_midi )
+                writeMidi(notes, batchOutputPath(result.path, config.output_dir, ".mid"));
+            if ( config.write_notes )
+                writeNoteArray(notes, batchOutputPath(result.path, config.output_dir, ".notes"));
+        }
+        catch ( const std::exception& e ) {
+            result.error = e.what();
+        }
+        finish(idx, start);
+    };
+
+    // output stem -> first input writing it
+    std::map<std::string, size_t> outputs;
+
+    for ( size_t idx = 0 ; idx < paths.size() ; idx++ ) {
+        results[idx].path = paths[idx];
+
+        // e.g. a/take.wav and b/take.wav into one output_dir, the second would overwrite the outputs
+        // of the first, possibly while they are written
+        const std::string output = fs::path(batchOutputPath(paths[idx], config.output_dir, "")).lexically_normal().string();
+        const auto first = outputs.emplace(output, idx);
+        if ( !first.second ) {
+            results[idx].error = "same outputs as " + paths[first.first->second];
+            std::lock_guard<std::mutex> lock(mutex);
+            n_submitted++;
+            report(idx);
+            continue;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return n_in_flight < max_in_flight; });
+            n_in_flight++;
+            n_submitted++;
+        }
+
+        pool->submit([&, idx] {
+            const Clock::time_point start = Clock::now();
+            BatchResult& result = results[idx];
+            Vectorf audio;
+            try {
+                audio = loadWav(result.path);
+                if ( audio.size() == 0 )
+                    throw std::runtime_error("no samples");
+            }
+            catch ( const std::exception& e ) {
+                result.error = e.what();
+                finish(idx, start);
+                return;
+            }
+            result.audio_seconds = audio.size() / static_cast<double>(SAMPLE_RATE);
+            result.decode_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            // a transcription of the same samples by the same weights
+            const std::shared_ptr<TranscriptionCache> cache = model.getCache();
+            const std::shared_ptr<const amtWeights> weights = model.getHandle() ? model.getHandle()->get() : model.getWeights();
+            CacheKey key;
+            if ( cache ) {
+                key = TranscriptionCache::key(audio, weights->fingerprint(), model.notesOnly());
+                Matrixf Yp, Yn, Yo;
+                NoteArray notes;
+                if ( cache->load(key, Yp, Yn, Yo, notes) ) {
+                    result.cached = true;
+                    complete(idx, start, notes);
+                    return;
+                }
+            }
+
+            // the pool is shared with other files unless this is the last one
+            int intra_threads = 1;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if ( n_submitted == paths.size() && n_in_flight == 1 )
+                    intra_threads = 0;
+            }
+
+            model.transcribeAsync(audio, [&, idx, start, cache, weights, key] ( std::shared_ptr<TranscriptionJob> job ) {
+                NoteArray notes;
+                try {
+                    notes = NoteArray::fromNotes(job->get());
+                }
+                catch ( const std::exception& e ) {
+                    results[idx].error = e.what();
+                    finish(idx, start);
+                    return;
+                }
+                // the key holds the fingerprint of the weights current at the lookup
+                if ( cache && job->weights() == weights )
+                    cache->store(key, job->Yp(), job->Yn(), job->Yo(), notes);
+                complete(idx, start, notes);
+            }, intra_threads);
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return n_in_flight == 0; });
+    return results;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "amtModel.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BatchConfig {
+    // directory of the outputs, empty writes them next to their input
+    std::string output_dir;
+    // <stem>.mid and <stem>.notes (see writeNoteArray)
+    bool write_midi = true;
+    bool write_notes = false;
+    // files decoded and transcribing at once, bounds the memory, 0 is twice the pool size
+    int max_in_flight = 0;
+};
+
+struct BatchResult {
+    std::string path;
+    // duration of the audio and time from the start of the decoding to the written outputs, in seconds
+    double audio_seconds = 0.0;
+    double decode_seconds = 0.0;
+    double wall_seconds = 0.0;
+    int n_notes = 0;
+    // taken from the cache of the model
+    bool cached = false;
+    // empty on success
+    std::string error;
+
+    // seconds of audio per second
+    double throughput() const { return wall_seconds > 0.0 ? audio_seconds / wall_seconds : 0.0; }
+};
+
+// the WAV files of inputs in order: directories are searched recursively in sorted order,
+// "@list.txt" names a file list with one path per line, any other input is taken as a file
+std::vector<std::string> collectInputFiles( const std::vector<std::string>& inputs );
+
+// output path of input with its extension replaced by extension
+std::string batchOutputPath( const std::string& input, const std::string& output_dir, const std::string& extension );
+
+// transcribe files on the pool of model: every file is decoded by one pool task and its windows are
+// pool tasks as well, up to config.max_in_flight files share the pool. while other files are in flight
+// every window runs single threaded, the last file spreads the pool over its windows.
+// files found in the cache of the model (amtModel::setCache) skip the transcription, new ones are stored.
+// on_result is called once per file as it finishes, serialized, in the order of completion, an exception it throws is logged.
+// a file whose outputs would replace those of an earlier file, e.g. two files of the same name from
+// different directories with one output_dir, fails without being transcribed.
+// returns the results in the order of paths, a failing file does not stop the batch
+std::vector<BatchResult> transcribeBatch( const amtModel& model, const std::vector<std::string>& paths,
+    const BatchConfig& config = BatchConfig(), const std::function<void(const BatchResult&)>& on_result = nullptr );
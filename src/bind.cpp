@@ -5,7 +5,16 @@
 #include "layer.h"
 #include "cnn.h"
 #include "amtModel.h"
+#include "amtWeights.h"
 #include "note.h"
+#include "midi.h"
+#include "realtimeTranscriber.h"
+#include "loader.h"
+#include "modelFile.h"
+#include "wavReader.h"
+#include "resampler.h"
+#include "batchTranscriber.h"
+#include "transcriptionCache.h"
 
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
@@ -66,6 +75,11 @@ py::array_t<float> mat3D2pyarray(VecMatrixf &tensor) {
     return pyarray;
 }
 
+template <typename T>
+py::array_t<T> vec2pyarray(const std::vector<T> &vec) {
+    return py::array_t<T>(vec.size(), vec.data());
+}
+
 VecMatrixf pyarray2mat3D(py::array_t<float> &pyarray) {
     auto r = pyarray.unchecked<3>();
     VecMatrixf tensor(r.shape(0), Matrixf::Zero(r.shape(1), r.shape(2)));
@@ -79,6 +93,24 @@ VecMatrixf pyarray2mat3D(py::array_t<float> &pyarray) {
     return tensor;
 }
 
+// streaming source backed by a python callable: read(n) returns at most n samples, empty at the end
+class PyCallbackReader : public AudioReader {
+    public:
+
+        PyCallbackReader( py::function read ) : _read(read) {}
+
+        int read( float* dst, int n_samples ) override {
+            py::array_t<float, py::array::c_style | py::array::forcecast> chunk = _read(n_samples);
+            int n = std::min( n_samples, static_cast<int>(chunk.size()) );
+            std::copy( chunk.data(), chunk.data() + n, dst );
+            return n;
+        }
+
+    private:
+
+        py::function _read;
+};
+
 void bind_nnUtils( py::module &m ) {
     auto m_nnUtils = m.def_submodule("nnUtils");
     m_nnUtils.def("im2col", &im2col);
@@ -89,15 +121,34 @@ void bind_nnUtils( py::module &m ) {
     });
 }
 
+// the decoder called from python runs on the calling thread with all worker threads
+struct DecoderThreads : ScopedIntraOpThreads {
+    DecoderThreads() : ScopedIntraOpThreads(getNumThreads()) {}
+};
+
 void bind_note( py::module &m ) {
     auto m_note = m.def_submodule("note");
-    m_note.def("getInferedOnsets", &getInferedOnsets);
-    m_note.def("modelOutput2Notes", &modelOutput2Notes);
+    m_note.def("getInferedOnsets", &getInferedOnsets, py::call_guard<DecoderThreads>());
+    m_note.def("getInferedOnsetLogits", &getInferedOnsetLogits, py::call_guard<DecoderThreads>());
+    m_note.def("modelOutput2Notes", &modelOutput2Notes,
+        py::arg("Yp"), py::arg("Yn"), py::arg("Yo"),
+        py::arg("melodia_trick") = true, py::arg("include_pitch_bends") = true, py::arg("onset_logits") = false,
+        py::arg("onset_threshold") = ONSET_THRESHOLD, py::arg("frame_threshold") = FRAME_THRESHOLD,
+        py::arg("min_note_length") = MIN_NOTE_LENGTH, py::call_guard<DecoderThreads>());
+    m_note.def("getPitchBends", [] ( const Matrixf& Yp, std::vector<Note> notes, int n_bins_tolerance ) {
+        getPitchBends(Yp, notes, n_bins_tolerance);
+        return notes;
+    }, py::arg("Yp"), py::arg("notes"), py::arg("n_bins_tolerance") = PITCH_BEND_BINS_TOLERANCE,
+        py::call_guard<DecoderThreads>());
     py::class_<Note>(m_note, "Note")
+        .def(py::init<>())
         .def_readwrite("start", &Note::start_time)
         .def_readwrite("end", &Note::end_time)
         .def_readwrite("pitch", &Note::pitch)
         .def_readwrite("amplitude", &Note::amplitude)
+        .def_readwrite("start_frame", &Note::start_frame)
+        .def_readwrite("end_frame", &Note::end_frame)
+        .def_readwrite("bends", &Note::bends)
         .def("__repr__",
         [] (const Note &note) {
             return std::to_string(note.start_time) + "\t"
@@ -106,6 +157,47 @@ void bind_note( py::module &m ) {
                 + std::to_string(note.amplitude);
         })
         ;
+    // columns of NoteArray are returned as numpy arrays
+    py::class_<NoteArray>(m_note, "NoteArray")
+        .def(py::init<>())
+        .def("__len__", &NoteArray::size)
+        // negative indices count from the end, out of range ones raise IndexError
+        .def("__getitem__", [] ( const NoteArray &notes, py::ssize_t idx ) {
+            if ( idx < 0 )
+                idx += notes.size();
+            if ( idx < 0 )
+                throw py::index_error("note index out of range");
+            return notes.at(idx);
+        })
+        .def("__iter__", [] ( const NoteArray &notes ) { return py::iter(py::cast(notes.toNotes())); })
+        .def("toNotes", &NoteArray::toNotes)
+        .def_static("fromNotes", &NoteArray::fromNotes, py::arg("notes"))
+        .def_property_readonly("start", [] ( const NoteArray &notes ) { return vec2pyarray(notes.start_time); })
+        .def_property_readonly("end", [] ( const NoteArray &notes ) { return vec2pyarray(notes.end_time); })
+        .def_property_readonly("start_frame", [] ( const NoteArray &notes ) { return vec2pyarray(notes.start_frame); })
+        .def_property_readonly("end_frame", [] ( const NoteArray &notes ) { return vec2pyarray(notes.end_frame); })
+        .def_property_readonly("pitch", [] ( const NoteArray &notes ) { return vec2pyarray(notes.pitch); })
+        .def_property_readonly("amplitude", [] ( const NoteArray &notes ) { return vec2pyarray(notes.amplitude); })
+        .def_property_readonly("bends", [] ( const NoteArray &notes ) { return vec2pyarray(notes.bends); })
+        .def_property_readonly("bend_offsets", [] ( const NoteArray &notes ) { return vec2pyarray(notes.bend_offsets); })
+        ;
+    m_note.def("modelOutput2NoteArray", &modelOutput2NoteArray,
+        py::arg("Yp"), py::arg("Yn"), py::arg("Yo"),
+        py::arg("melodia_trick") = true, py::arg("include_pitch_bends") = true, py::arg("onset_logits") = false,
+        py::arg("onset_threshold") = ONSET_THRESHOLD, py::arg("frame_threshold") = FRAME_THRESHOLD,
+        py::arg("min_note_length") = MIN_NOTE_LENGTH, py::call_guard<DecoderThreads>());
+    m_note.def("writeNoteArray", &writeNoteArray, py::arg("notes"), py::arg("path"));
+    m_note.def("readNoteArray", &readNoteArray, py::arg("path"));
+}
+
+void bind_midi( py::module &m ) {
+    auto m_midi = m.def_submodule("midi");
+    m_midi.def("writeMidi",
+        py::overload_cast<const std::vector<Note>&, const std::string&, const float, const bool>(&writeMidi),
+        py::arg("notes"), py::arg("path"), py::arg("midi_tempo") = MIDI_TEMPO, py::arg("include_pitch_bends") = true);
+    m_midi.def("writeMidi",
+        py::overload_cast<const NoteArray&, const std::string&, const float, const bool>(&writeMidi),
+        py::arg("notes"), py::arg("path"), py::arg("midi_tempo") = MIDI_TEMPO, py::arg("include_pitch_bends") = true);
 }
 
 void bind_layer( py::module &m ) {
@@ -140,6 +232,7 @@ void bind_layer( py::module &m ) {
 void bind_cnn( py::module &m ) {
     py::class_<CNN>(m, "CNN")
         .def(py::init<std::string>())
+        .def(py::init<std::string, std::string>(), py::arg("model_name"), py::arg("path"))
         .def("__repr__",
         [] (const CNN &cnn) {
             return cnn.get_name();
@@ -154,14 +247,149 @@ void bind_cnn( py::module &m ) {
             Matrixf weights = dynamic_cast<Conv2D*>(layers[0])->getWeights()[0][0];
             return weights;
         });
+
+    // json to binary model file, see tools/convertModel.cpp
+    m.def("convertModel", [] ( const std::string& json_path, const std::string& bin_path ) {
+        std::vector<Layer*> layers;
+        loadJsonLayers(layers, json_path);
+        writeModelFile(layers, bin_path);
+        for ( Layer* layer : layers )
+            delete layer;
+    }, py::arg("json_path"), py::arg("bin_path"));
 }
 
 // bind the amtModel class
 void bind_amtModel( py::module &m ) {
+    py::class_<PipelineConfig>(m, "PipelineConfig")
+        .def(py::init<>())
+        .def_readwrite("enabled", &PipelineConfig::enabled)
+        .def_readwrite("cqt_threads", &PipelineConfig::cqt_threads)
+        .def_readwrite("cnn_threads", &PipelineConfig::cnn_threads)
+        .def_readwrite("queue_capacity", &PipelineConfig::queue_capacity)
+        ;
+    py::class_<StreamConfig>(m, "StreamConfig")
+        .def(py::init<>())
+        .def_readwrite("segment_windows", &StreamConfig::segment_windows)
+        .def_readwrite("context_frames", &StreamConfig::context_frames)
+        ;
+    py::class_<ModelConfig>(m, "ModelConfig")
+        .def(py::init<>())
+        .def_readwrite("model_dir", &ModelConfig::model_dir)
+        .def_readwrite("parallel", &ModelConfig::parallel)
+        .def_readwrite("lazy", &ModelConfig::lazy)
+        ;
+    py::class_<amtWeights, std::shared_ptr<amtWeights>>(m, "amtWeights")
+        .def(py::init<>())
+        .def(py::init<const ModelConfig&>(), py::arg("config"), py::call_guard<py::gil_scoped_release>())
+        .def_static("shared", [] ( const ModelConfig& config ) {
+            return std::const_pointer_cast<amtWeights>(amtWeights::shared(config));
+        }, py::arg("config") = ModelConfig())
+        .def("fingerprint", &amtWeights::fingerprint, py::call_guard<py::gil_scoped_release>())
+        ;
+    py::class_<ModelHandle, std::shared_ptr<ModelHandle>>(m, "ModelHandle")
+        .def(py::init<const ModelConfig&>(), py::arg("config") = ModelConfig(), py::call_guard<py::gil_scoped_release>())
+        .def(py::init([] ( std::shared_ptr<amtWeights> weights ) {
+            return std::make_shared<ModelHandle>(weights);
+        }), py::arg("weights"))
+        .def("get", [] ( const ModelHandle& handle ) {
+            return std::const_pointer_cast<amtWeights>(handle.get());
+        })
+        .def("version", &ModelHandle::version)
+        // loading runs without the GIL, so Python threads keep serving requests meanwhile
+        .def("reload", &ModelHandle::reload, py::arg("config"), py::call_guard<py::gil_scoped_release>())
+        .def("swap", &ModelHandle::swap, py::arg("weights"), py::call_guard<py::gil_scoped_release>())
+        ;
+    py::register_exception<TranscriptionCancelled>(m, "TranscriptionCancelled", PyExc_RuntimeError);
+    py::class_<TranscriptionJob, std::shared_ptr<TranscriptionJob>>(m, "TranscriptionJob")
+        .def("numWindows", &TranscriptionJob::numWindows)
+        .def("windowsDone", &TranscriptionJob::windowsDone)
+        .def("progress", &TranscriptionJob::progress)
+        .def("cancel", &TranscriptionJob::cancel)
+        .def("cancelled", &TranscriptionJob::cancelled)
+        .def("done", &TranscriptionJob::done)
+        .def("get", &TranscriptionJob::get, py::call_guard<py::gil_scoped_release>())
+        ;
+    py::class_<PosteriorgramBlock>(m, "PosteriorgramBlock")
+        .def_readonly("start_frame", &PosteriorgramBlock::start_frame)
+        .def_readonly("Yp", &PosteriorgramBlock::Yp)
+        .def_readonly("Yn", &PosteriorgramBlock::Yn)
+        .def_readonly("Yo", &PosteriorgramBlock::Yo)
+        ;
+    py::class_<RealtimeTranscriber>(m, "RealtimeTranscriber")
+        .def(py::init([] ( std::shared_ptr<amtWeights> weights, int cqt_block_frames ) {
+            return new RealtimeTranscriber(weights, cqt_block_frames);
+        }), py::arg("weights"), py::arg("cqt_block_frames") = 8)
+        .def("push", &RealtimeTranscriber::push, py::call_guard<py::gil_scoped_release>())
+        .def("flush", &RealtimeTranscriber::flush, py::call_guard<py::gil_scoped_release>())
+        .def("latencySamples", &RealtimeTranscriber::latencySamples)
+        .def("reset", &RealtimeTranscriber::reset)
+        ;
     py::class_<amtModel>(m, "amtModel")
         .def(py::init<>())
-        .def("transcribeAudio", &amtModel::transcribeAudio)
+        .def(py::init<const ModelConfig&>(), py::arg("config"))
+        // sessions sharing the weights and the worker pool of another model
+        .def(py::init([] ( std::shared_ptr<amtWeights> weights ) {
+            return new amtModel(weights);
+        }), py::arg("weights"))
+        .def(py::init([] ( std::shared_ptr<ModelHandle> handle ) {
+            return new amtModel(handle);
+        }), py::arg("handle"))
+        .def(py::init([] ( const amtModel& model ) {
+            if ( model.getHandle() )
+                return new amtModel(model.getHandle(), model.getPool());
+            return new amtModel(model.getWeights(), model.getPool());
+        }), py::arg("model"))
+        .def("getWeights", [] ( const amtModel& model ) {
+            return std::const_pointer_cast<amtWeights>(model.getWeights());
+        })
+        // release the GIL so that sessions can transcribe concurrently from Python threads
+        .def("transcribeAudio", &amtModel::transcribeAudio, py::call_guard<py::gil_scoped_release>())
+        .def("setNotesOnly", &amtModel::setNotesOnly, py::arg("notes_only") = true)
+        .def("setPipelineConfig", &amtModel::setPipelineConfig)
+        // on_done runs on a pool thread with the GIL acquired, an exception it raises is reported
+        // through sys.unraisablehook
+        .def("transcribeAsync", [] ( const amtModel& model, const Vectorf& audio, py::object on_done ) {
+            if ( on_done.is_none() )
+                return model.transcribeAsync(audio);
+            // the callback may be released on a pool thread, which needs the GIL as well
+            std::shared_ptr<py::object> callback( new py::object(on_done), [] ( py::object* f ) {
+                py::gil_scoped_acquire gil;
+                delete f;
+            });
+            return model.transcribeAsync(audio, [callback] ( std::shared_ptr<TranscriptionJob> job ) {
+                py::gil_scoped_acquire gil;
+                try {
+                    (*callback)(job);
+                }
+                catch ( py::error_already_set& e ) {
+                    e.discard_as_unraisable(*callback);
+                }
+            });
+        }, py::arg("audio"), py::arg("on_done") = py::none())
+        // the GIL stays held, read and on_notes are called from the calling thread
+        .def("transcribeStream", [] ( amtModel& model, py::function read, const StreamConfig& config ) {
+            PyCallbackReader reader(read);
+            return model.transcribeStream(reader, config);
+        }, py::arg("read"), py::arg("config") = StreamConfig())
+        .def("transcribeStream", [] ( amtModel& model, py::function read, py::function on_notes, const StreamConfig& config ) {
+            PyCallbackReader reader(read);
+            model.transcribeStream(reader, [&on_notes] ( const NoteArray& notes ) { on_notes(notes); }, config);
+        }, py::arg("read"), py::arg("on_notes"), py::arg("config") = StreamConfig())
+        // streams the mapped file through the model without loading it, resampled to SAMPLE_RATE
+        .def("transcribeFile", [] ( amtModel& model, const std::string& path, const StreamConfig& config ) {
+            WavReader reader(path);
+            return model.transcribeStream(reader, config);
+        }, py::arg("path"), py::arg("config") = StreamConfig(), py::call_guard<py::gil_scoped_release>())
+        .def("setCache", &amtModel::setCache, py::arg("cache"))
+        .def("getCache", &amtModel::getCache)
+        .def("decode", &amtModel::decode, py::arg("onset_threshold") = ONSET_THRESHOLD,
+            py::arg("frame_threshold") = FRAME_THRESHOLD, py::arg("min_note_length") = MIN_NOTE_LENGTH)
         .def("getOutput", &amtModel::getOutput)
+        // copies of the posteriorgrams, the next transcription resizes the buffers
+        // while the GIL is released so views of them could dangle
+        .def("getYp", &amtModel::getYp, py::return_value_policy::copy)
+        .def("getYn", &amtModel::getYn, py::return_value_policy::copy)
+        .def("getYo", &amtModel::getYo, py::return_value_policy::copy)
         .def("getCQ", &amtModel::getCQ)
         ;
 }
@@ -181,6 +409,84 @@ void bind_utils( py::module &m ) {
     m_utils.def("getWindowedAudio", &getWindowedAudio);
 }
 
+// bind the wav reader
+void bind_wavReader( py::module &m ) {
+    py::class_<WavInfo>(m, "WavInfo")
+        .def_readonly("sample_rate", &WavInfo::sample_rate)
+        .def_readonly("n_channels", &WavInfo::n_channels)
+        .def_readonly("n_frames", &WavInfo::n_frames)
+        .def_readonly("bits_per_sample", &WavInfo::bits_per_sample)
+        .def_readonly("is_float", &WavInfo::is_float)
+        ;
+
+    py::class_<WavReader>(m, "WavReader")
+        .def(py::init<const std::string&>(), py::arg("path"))
+        .def("info", &WavReader::info, py::return_value_policy::reference_internal)
+        // (n, n_channels) frames, fewer at the end of the file
+        .def("readFrames", [] ( WavReader& reader, int n_frames ) {
+            const int n_channels = reader.info().n_channels;
+            py::array_t<float> frames({ n_frames, n_channels });
+            const int n = reader.readFrames(frames.mutable_data(), n_frames);
+            frames.resize({ n, n_channels });
+            return frames;
+        }, py::arg("n_frames"))
+        .def("seek", &WavReader::seek)
+        .def("position", &WavReader::position)
+        ;
+
+    // (mono audio, sample rate), sample_rate 0 keeps the sample rate of the file
+    m.def("loadWav", [] ( const std::string& path, int sample_rate ) {
+        Vectorf audio;
+        {
+            py::gil_scoped_release release;
+            audio = loadWav(path, sample_rate);
+            if ( sample_rate <= 0 )
+                sample_rate = WavReader(path).info().sample_rate;
+        }
+        return py::make_tuple(audio, sample_rate);
+    }, py::arg("path"), py::arg("sample_rate") = SAMPLE_RATE);
+    m.def("resample", &resample, py::arg("audio"), py::arg("rate_in"), py::arg("rate_out") = SAMPLE_RATE,
+        py::call_guard<py::gil_scoped_release>());
+    // (frames, channels) to mono
+    m.def("downmix", &downmix, py::arg("frames"));
+}
+
+// bind the batch transcription
+void bind_batchTranscriber( py::module &m ) {
+    py::class_<BatchConfig>(m, "BatchConfig")
+        .def(py::init<>())
+        .def_readwrite("output_dir", &BatchConfig::output_dir)
+        .def_readwrite("write_midi", &BatchConfig::write_midi)
+        .def_readwrite("write_notes", &BatchConfig::write_notes)
+        .def_readwrite("max_in_flight", &BatchConfig::max_in_flight)
+        ;
+
+    py::class_<BatchResult>(m, "BatchResult")
+        .def_readonly("path", &BatchResult::path)
+        .def_readonly("audio_seconds", &BatchResult::audio_seconds)
+        .def_readonly("decode_seconds", &BatchResult::decode_seconds)
+        .def_readonly("wall_seconds", &BatchResult::wall_seconds)
+        .def_readonly("n_notes", &BatchResult::n_notes)
+        .def_readonly("cached", &BatchResult::cached)
+        .def_readonly("error", &BatchResult::error)
+        .def("throughput", &BatchResult::throughput)
+        ;
+
+    py::class_<TranscriptionCache, std::shared_ptr<TranscriptionCache>>(m, "TranscriptionCache")
+        .def(py::init<const std::string&, int, uint64_t>(), py::arg("dir"), py::arg("compression_level") = 1,
+            py::arg("max_bytes") = 0)
+        .def("dir", &TranscriptionCache::dir)
+        .def("maxBytes", &TranscriptionCache::maxBytes)
+        .def("hits", &TranscriptionCache::hits)
+        .def("misses", &TranscriptionCache::misses)
+        ;
+
+    m.def("collectInputFiles", &collectInputFiles, py::arg("inputs"));
+    m.def("transcribeBatch", [] ( const amtModel& model, const std::vector<std::string>& paths, const BatchConfig& config ) {
+        return transcribeBatch(model, paths, config);
+    }, py::arg("model"), py::arg("paths"), py::arg("config") = BatchConfig(), py::call_guard<py::gil_scoped_release>());
+}
+
 // bind the CQParams class
 void bind_CQParams( py::module &m ) {
     py::class_<CQParams>(m, "CQParams")
@@ -220,12 +526,21 @@ void bind_CQ( py::module &m ) {
 
 PYBIND11_MODULE(BasiCPP_Pitch, m) {
     m.doc() = "BasiCPP_Pitch: A C++ implementation of the pitch detection algorithm";
+    // the weights of DEFAULT_MODEL_DIR are compiled into the module, see embeddedModel.h
+#ifdef EMBED_MODEL
+    m.attr("EMBED_MODEL") = true;
+#else
+    m.attr("EMBED_MODEL") = false;
+#endif
     bind_amtModel(m);
     bind_CQParams(m);
     bind_CQ(m);
     bind_layer(m);
     bind_cnn(m);
     bind_note(m);
+    bind_midi(m);
     bind_utils(m);
+    bind_wavReader(m);
+    bind_batchTranscriber(m);
     bind_nnUtils(m);
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// blocking FIFO with a fixed capacity, push blocks while the queue is full (backpressure)
+// after close(), push fails and pop drains the remaining items before failing
+template <typename T>
+class BoundedQueue {
+    public:
+
+        BoundedQueue( size_t capacity ) : _capacity( capacity > 0 ? capacity : 1 ) {}
+
+        bool push( T item ) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_full.wait( lock, [this] { return _closed || _items.size() < _capacity; } );
+            if ( _closed )
+                return false;
+            _items.emplace_back( std::move(item) );
+            _not_empty.notify_one();
+            return true;
+        }
+
+        bool pop( T& item ) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_empty.wait( lock, [this] { return _closed || !_items.empty(); } );
+            if ( _items.empty() )
+                return false;
+            item = std::move( _items.front() );
+            _items.pop_front();
+            _not_full.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _not_full.notify_all();
+            _not_empty.notify_all();
+        }
+
+    private:
+
+        size_t _capacity;
+        std::deque<T> _items;
+        std::mutex _mutex;
+        std::condition_variable _not_full;
+        std::condition_variable _not_empty;
+        bool _closed = false;
+};
@@ -1,29 +1,143 @@
 #include "cnn.h"
 #include "constant.h"
 #include "loader.h"
+#include <atomic>
 #include <iostream>
+#include <unordered_map>
 
-CNN::CNN( const std::string model_name ) : _model_name( model_name ) {
+inline uint64_t nextCNNId() {
+    static std::atomic<uint64_t> next_id( 0 );
+    return next_id++;
+}
+
+CNN::CNN( const std::string model_name ) :
+    _model_name( model_name ), _id( nextCNNId() ), _alive( std::make_shared<const bool>( true ) ) {
     // std::cout << "CNN " + model_name + " constructor called" << std::endl;
     // loadCNNModel( _layers, model_name );
     getLayers( _layers, model_name );
+    planActivations();
     // std::cout << get_name() << std::endl;
 }
 
+CNN::CNN( const std::string model_name, const std::string path ) :
+    _model_name( model_name ), _id( nextCNNId() ), _alive( std::make_shared<const bool>( true ) ) {
+    loadLayers( _layers, path );
+    planActivations();
+}
+
+CNN::CNN( const std::string model_name, std::vector<Layer*> layers ) :
+    _layers( std::move( layers ) ), _model_name( model_name ), _id( nextCNNId() ), _alive( std::make_shared<const bool>( true ) ) {
+    planActivations();
+}
+
 CNN::~CNN() {
     for ( size_t i = 0 ; i < _layers.size() ; i++ ) {
         delete _layers[i];
     }
 }
 
-VecMatrixf CNN::forward( const VecMatrixf& input ) const {
+VecMatrixf CNN::forward( const VecMatrixf& input, bool skip_final_sigmoid ) const {
+    VecMatrixf output;
+    forward( input, output, skip_final_sigmoid );
+    return output;
+}
+
+// copy src into dst, reusing the memory of dst
+inline void assignTensor( VecMatrixf& dst, const VecMatrixf& src ) {
+    dst.resize( src.size() );
+    for ( size_t i = 0 ; i < src.size() ; i++ )
+        dst[i] = src[i];
+}
+
+void CNN::forward( const VecMatrixf& input, VecMatrixf& output, bool skip_final_sigmoid ) const {
     // std::cout << _model_name + " forward pass" << std::endl;
-    VecMatrixf output = input;
-    for ( size_t i = 0 ; i < _layers.size() ; i++ ) {
-        output = _layers[i]->forward( output );
+    size_t n_layers = _layers.size();
+    if ( skip_final_sigmoid && n_layers > 0 && _layers.back()->type == LayerType::SIGMOID )
+        n_layers--;
+
+    Workspace& ws = workspace();
+    int current = -1; // activation buffer holding the latest output, -1 for the input
+    for ( size_t i = 0 ; i < n_layers ; i++ ) {
+        const Layer* layer = _layers[i];
+        int slot = _activation_slot[i];
+        if ( slot < 0 ) {
+            layer->forwardInPlace( ws.activations[current] );
+            continue;
+        }
+        const VecMatrixf& x = current < 0 ? input : ws.activations[current];
+        if ( layer->inPlace() ) {
+            assignTensor( ws.activations[slot], x );
+            layer->forwardInPlace( ws.activations[slot] );
+        }
+        else {
+            layer->forwardInto( x, ws.activations[slot], ws.scratch[i] );
+        }
+        current = slot;
     }
     // std::cout << "output size = " << output.size() << std::endl;
-    return output;
+    assignTensor( output, current < 0 ? input : ws.activations[current] );
+}
+
+void CNN::forwardStream( const VecMatrixf& input, VecMatrixf& output, std::vector<VecMatrixf>& state, bool flush, bool skip_final_sigmoid ) const {
+    size_t n_layers = _layers.size();
+    if ( skip_final_sigmoid && n_layers > 0 && _layers.back()->type == LayerType::SIGMOID )
+        n_layers--;
+
+    state.resize(_layers.size());
+    VecMatrixf x = input, y;
+    for ( size_t i = 0 ; i < n_layers ; i++ ) {
+        _layers[i]->forwardStream( x, y, state[i], flush );
+        std::swap( x, y );
+    }
+    output = std::move(x);
+}
+
+int CNN::lookAhead() const {
+    int look_ahead = 0;
+    for ( const Layer* layer : _layers )
+        look_ahead += layer->lookAhead();
+    return look_ahead;
+}
+
+Workspace& CNN::workspace() const {
+    struct Entry {
+        std::weak_ptr<const bool> alive;
+        Workspace ws;
+    };
+    thread_local std::unordered_map<uint64_t, Entry> workspaces;
+
+    auto it = workspaces.find( _id );
+    if ( it != workspaces.end() )
+        return it->second.ws;
+
+    // first pass of this CNN on this thread, free the workspaces of destroyed CNNs first
+    for ( auto e = workspaces.begin() ; e != workspaces.end() ; ) {
+        if ( e->second.alive.expired() )
+            e = workspaces.erase( e );
+        else
+            ++e;
+    }
+    Entry& entry = workspaces[_id];
+    entry.alive = _alive;
+    entry.ws.scratch.resize( _layers.size() );
+    return entry.ws;
+}
+
+void CNN::planActivations() {
+    _activation_slot.clear();
+    int slot = 0;
+    bool on_input = true;
+    for ( const Layer* layer : _layers ) {
+        // the input belongs to the caller, in place layers need a copy of it
+        if ( layer->inPlace() && !on_input ) {
+            _activation_slot.push_back( -1 );
+        }
+        else {
+            _activation_slot.push_back( slot );
+            slot ^= 1;
+            on_input = false;
+        }
+    }
 }
 
 std::string CNN::get_name() const {
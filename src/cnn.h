@@ -4,6 +4,17 @@
 #include "layer.h"
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <memory>
+
+// scratch memory of one CNN on one thread, kept between forward passes so that
+// windows of the same shape run without heap allocations after the first one
+struct Workspace {
+    // ping-pong buffers for the layer outputs
+    VecMatrixf activations[2];
+    // layer specific scratch, e.g. the padded input of a Conv2D
+    std::vector<VecMatrixf> scratch;
+};
 
 
 class CNN {
@@ -11,10 +22,28 @@ class CNN {
 
         CNN( const std::string model_name );
 
+        // load the layers from a json or a binary model file instead of the default one
+        CNN( const std::string model_name, const std::string path );
+
+        // take ownership of layers, e.g. those getLayers loaded from a model directory
+        CNN( const std::string model_name, std::vector<Layer*> layers );
+
         ~CNN();
     
         // inference API for Eigen IO
-        VecMatrixf forward( const VecMatrixf& input ) const;
+        // skip_final_sigmoid: return the logits if the last layer is a Sigmoid
+        VecMatrixf forward( const VecMatrixf& input, bool skip_final_sigmoid = false ) const;
+
+        // same as above, output keeps its memory when the shape is unchanged
+        void forward( const VecMatrixf& input, VecMatrixf& output, bool skip_final_sigmoid = false ) const;
+
+        // incremental inference over time, see Layer::forwardStream
+        // state holds one history per layer and starts empty
+        void forwardStream( const VecMatrixf& input, VecMatrixf& output, std::vector<VecMatrixf>& state,
+            bool flush, bool skip_final_sigmoid = false ) const;
+
+        // frames of the future an output frame depends on
+        int lookAhead() const;
 
         std::string get_name() const;
 
@@ -23,7 +52,23 @@ class CNN {
     // private:
     protected:
 
+        // workspace of the calling thread for this CNN, no locking. the workspaces of a thread are keyed by
+        // _id, which is never reused, and those of destroyed CNNs are freed when the thread creates a new one
+        Workspace& workspace() const;
+
+        // compute _activation_slot from the layer list
+        void planActivations();
+
         std::vector<Layer*> _layers;
+
+        // memory plan, the activation buffer each layer writes to, -1 for layers
+        // working in place on the output of the previous layer
+        std::vector<int> _activation_slot;
     
         std::string _model_name;
+
+        // unique per instance, unlike the address
+        const uint64_t _id;
+        // expires with the CNN, tells the threads that its workspaces can go
+        const std::shared_ptr<const bool> _alive;
 };
\ No newline at end of file
@@ -2,6 +2,10 @@
 #define CONSTANT_H
 
 #include <cmath>
+#include <string>
+
+// directory of the model files, relative to the working directory
+inline const std::string DEFAULT_MODEL_DIR = "model";
 
 inline constexpr int SAMPLE_RATE = 22050;
 
@@ -65,6 +69,12 @@ inline constexpr int MIN_NOTE_LENGTH = 11;
 
 inline constexpr int MIDI_OFFSET = 21;
 
+// pitch bend search range around the note center, in contour bins
+inline constexpr int PITCH_BEND_BINS_TOLERANCE = 25;
+
+// std of the gaussian weighting the pitch bend search range
+inline constexpr float PITCH_BEND_GAUSSIAN_STD = 5.0f;
+
 // 0.0018 is a magic number, but it's needed for this to align properly
 inline constexpr float WINDOW_OFFSET = static_cast<float>(FFT_HOP) / SAMPLE_RATE \
      * (ANNOT_N_FRAMES - (AUDIO_N_SAMPLES * 1.0f / FFT_HOP)) + 0.0018f;
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "layer.h"
+#include "typedef.h"
+#include <complex>
+#include <string>
+#include <vector>
+
+// CNN weights, CQT kernel and low pass filter compiled into the binary, built with -DEMBED_MODEL=ON
+// the source is generated from model/*.json, model/kernel.npy and model/lowpass_filter.npy by tools/embedModel.py
+// they stand in for DEFAULT_MODEL_DIR, any other model directory is still loaded from its files
+
+// append the layers of the named model, false when the model is not embedded
+bool getEmbeddedLayers( std::vector<Layer*>& layers, const std::string& model_name );
+
+// the CQT kernel, shape ( n_bins, kernel_length ), static storage
+const std::complex<float>* getEmbeddedKernel( int& n_bins, int& kernel_length );
+
+void getEmbeddedLowPassFilter( Vectorf& filter_kernel );
@@ -0,0 +1,67 @@
+#include "hash.h"
+#include <cstring>
+
+inline constexpr uint64_t HASH_PRIME_1 = 0x9E3779B185EBCA87ull;
+inline constexpr uint64_t HASH_PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+inline constexpr uint64_t HASH_PRIME_3 = 0x165667B19E3779F9ull;
+inline constexpr uint64_t HASH_PRIME_4 = 0x85EBCA77C2B2AE63ull;
+inline constexpr uint64_t HASH_PRIME_5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl( uint64_t x, int r ) { return ( x << r ) | ( x >> ( 64 - r ) ); }
+
+inline uint64_t load64( const uint8_t* p ) { uint64_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+
+inline uint32_t load32( const uint8_t* p ) { uint32_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+
+inline uint64_t round64( uint64_t acc, uint64_t input ) {
+    return rotl(acc + input * HASH_PRIME_2, 31) * HASH_PRIME_1;
+}
+
+inline uint64_t mergeRound( uint64_t acc, uint64_t lane ) {
+    return ( acc ^ round64(0, lane) ) * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+uint64_t hash64( const void* data, size_t n, uint64_t seed ) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + n;
+    uint64_t h;
+
+    if ( n >= 32 ) {
+        uint64_t v1 = seed + HASH_PRIME_1 + HASH_PRIME_2;
+        uint64_t v2 = seed + HASH_PRIME_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - HASH_PRIME_1;
+        for ( ; p + 32 <= end ; p += 32 ) {
+            v1 = round64(v1, load64(p));
+            v2 = round64(v2, load64(p + 8));
+            v3 = round64(v3, load64(p + 16));
+            v4 = round64(v4, load64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    }
+    else {
+        h = seed + HASH_PRIME_5;
+    }
+    h += n;
+
+    // tail of less than 32 bytes
+    for ( ; p + 8 <= end ; p += 8 )
+        h = rotl(h ^ round64(0, load64(p)), 27) * HASH_PRIME_1 + HASH_PRIME_4;
+    if ( p + 4 <= end ) {
+        h = rotl(h ^ ( load32(p) * HASH_PRIME_1 ), 23) * HASH_PRIME_2 + HASH_PRIME_3;
+        p += 4;
+    }
+    for ( ; p < end ; p++ )
+        h = rotl(h ^ ( *p * HASH_PRIME_5 ), 11) * HASH_PRIME_1;
+
+    h ^= h >> 33;
+    h *= HASH_PRIME_2;
+    h ^= h >> 29;
+    h *= HASH_PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// fast 64 bit hash (the xxHash64 construction), four independent lanes of 8 byte words,
+// several GB/s, not cryptographic. see fnv1a in modelFile.h for the checksum of the model files
+uint64_t hash64( const void* data, size_t n, uint64_t seed = 0 );
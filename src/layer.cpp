@@ -7,6 +7,20 @@ Conv2D::Conv2D( int& json_idx, const json& weights ) : Layer(LayerType::CONV2D)
     loadWeights( json_idx, weights );
 }
 
+Conv2D::Conv2D( int n_filters_in, int n_filters_out, int n_features_in, int kernel_size_time, int kernel_size_feature,
+    int stride, std::shared_ptr<const float> kernel, const float* bias ) :
+    Layer(LayerType::CONV2D),
+    _n_filters_in(n_filters_in),
+    _n_filters_out(n_filters_out),
+    _n_features_in(n_features_in),
+    _n_features_out(computeNFeaturesOut(n_features_in, kernel_size_feature, stride)),
+    _kernel_size_time(kernel_size_time),
+    _kernel_size_feature(kernel_size_feature),
+    _stride(stride),
+    _kernel(kernel),
+    _bias(bias, bias + n_filters_out) {
+}
+
 std::string Conv2D::get_name() const{
     
     return std::to_string(_n_filters_out) + 
@@ -18,10 +32,116 @@ std::string Conv2D::get_name() const{
 
 VecMatrixf Conv2D::forward( const VecMatrixf& input ) const {
 
-    return forward_naive(input);
+    VecMatrixf output, padded;
+    forwardInto(input, output, padded);
+    return output;
+    // return forward_naive(input);
     // return forward_im2col(input);
 }
 
+// same arithmetic as forward_naive, but every input channel is padded once (not once per
+// output filter) into scratch, and the results are accumulated directly into output
+void Conv2D::forwardInto( const VecMatrixf& input, VecMatrixf& output, VecMatrixf& padded ) const {
+    int n_frames_in = input[0].rows();
+    int pad_height = _kernel_size_time - 1;
+    int pad_width = (_n_features_out - 1) * _stride + _kernel_size_feature - _n_features_in;
+
+    // resize() keeps the memory when the shape is unchanged
+    padded.resize(_n_filters_in);
+    for ( int i = 0 ; i < _n_filters_in ; i++ ) {
+        padded[i].resize(n_frames_in + pad_height, _n_features_in + pad_width);
+        padded[i].setZero();
+        padded[i].block(pad_height / 2, pad_width / 2, n_frames_in, _n_features_in) = input[i];
+    }
+    convolvePadded(padded, output, n_frames_in);
+}
+
+void Conv2D::forwardStream( const VecMatrixf& input, VecMatrixf& output, VecMatrixf& history, bool flush ) const {
+    int n_frames_in = input.empty() ? 0 : input[0].rows();
+    int pad_height = _kernel_size_time - 1;
+    int pad_width = (_n_features_out - 1) * _stride + _kernel_size_feature - _n_features_in;
+
+    // the top half of the 'same' padding at the start of the stream
+    if ( history.empty() )
+        history.assign(_n_filters_in, Matrixf::Zero(pad_height / 2, _n_features_in + pad_width));
+
+    // history, new frames and at the end of the stream the bottom half of the padding
+    int n_rows = history[0].rows() + n_frames_in + (flush ? lookAhead() : 0);
+    VecMatrixf padded(_n_filters_in);
+    for ( int i = 0 ; i < _n_filters_in ; i++ ) {
+        padded[i] = Matrixf::Zero(n_rows, _n_features_in + pad_width);
+        padded[i].topRows(history[i].rows()) = history[i];
+        if ( n_frames_in > 0 )
+            padded[i].block(history[i].rows(), pad_width / 2, n_frames_in, _n_features_in) = input[i];
+    }
+    convolvePadded(padded, output, std::max(0, n_rows - pad_height));
+
+    for ( int i = 0 ; i < _n_filters_in ; i++ )
+        history[i] = padded[i].bottomRows(std::min(n_rows, pad_height));
+}
+
+void Conv2D::convolvePadded( const VecMatrixf& padded, VecMatrixf& output, int n_frames_out ) const {
+    output.resize(_n_filters_out);
+    for ( int j = 0 ; j < _n_filters_out ; j++ ) {
+        output[j].resize(n_frames_out, _n_features_out);
+    }
+
+    // work is split by block of output filters, and by time tile when there are more threads than blocks
+    const int block = kernelBlock(_n_filters_out);
+    const int n_blocks = _n_filters_out / block;
+    const int n_threads = getIntraOpThreads();
+    const int n_tiles = n_threads > n_blocks ? (n_threads + n_blocks - 1) / n_blocks : 1;
+    const int tile_length = (n_frames_out + n_tiles - 1) / n_tiles;
+
+#pragma omp parallel for num_threads(n_threads) if(n_threads > 1) schedule(dynamic)
+    for ( int w = 0 ; w < n_blocks * n_tiles ; w++ ) {
+        int j = w / n_tiles * block;
+        int row_begin = (w % n_tiles) * tile_length;
+        int row_end = std::min(n_frames_out, row_begin + tile_length);
+        if ( row_begin >= row_end )
+            continue;
+        if ( block == KERNEL_BLOCK ) {
+            convolveBlock(padded, output, j, row_begin, row_end);
+            continue;
+        }
+        Matrixf& out = output[j];
+        out.middleRows(row_begin, row_end - row_begin).setZero();
+        for ( int i = 0 ; i < _n_filters_in ; i++ ) {
+            const KernelMap kernel = this->kernel(i, j);
+            for ( int t = row_begin ; t < row_end ; t++ ) {
+                for ( int f = 0 ; f < _n_features_out ; f++ ) {
+                    out(t, f) += padded[i].block(t, f * _stride, _kernel_size_time, _kernel_size_feature).cwiseProduct(kernel).sum();
+                }
+            }
+        }
+        out.middleRows(row_begin, row_end - row_begin).array() += _bias[j];
+    }
+}
+
+void Conv2D::convolveBlock( const VecMatrixf& padded, VecMatrixf& output, int j_begin, int row_begin, int row_end ) const {
+    const int kernel_length = _kernel_size_time * _kernel_size_feature * KERNEL_BLOCK;
+    const float* block_kernel = _kernel.get() + static_cast<size_t>(j_begin / KERNEL_BLOCK) * _n_filters_in * kernel_length;
+
+    for ( int t = row_begin ; t < row_end ; t++ ) {
+        for ( int f = 0 ; f < _n_features_out ; f++ ) {
+            // one input value times the weights of the whole block
+            float acc[KERNEL_BLOCK] = {};
+            const float* w = block_kernel;
+            for ( int i = 0 ; i < _n_filters_in ; i++ ) {
+                for ( int kt = 0 ; kt < _kernel_size_time ; kt++ ) {
+                    const float* x = &padded[i](t + kt, f * _stride);
+                    for ( int kf = 0 ; kf < _kernel_size_feature ; kf++, w += KERNEL_BLOCK ) {
+                        for ( int o = 0 ; o < KERNEL_BLOCK ; o++ )
+                            acc[o] += x[kf] * w[o];
+                    }
+                }
+            }
+            for ( int o = 0 ; o < KERNEL_BLOCK ; o++ )
+                output[j_begin + o](t, f) = acc[o] + _bias[j_begin + o];
+        }
+    }
+}
+
 // naive implementation of 2D convolution
 VecMatrixf Conv2D::forward_naive( const VecMatrixf& input ) const{
     // std::cout << "\t" << get_name() << " forward pass" << std::endl;
@@ -29,9 +149,21 @@ VecMatrixf Conv2D::forward_naive( const VecMatrixf& input ) const{
     int n_frames_out = n_frames_in;
     VecMatrixf output(_n_filters_out, Matrixf::Zero(n_frames_out, _n_features_out));
 
-    for ( int i = 0 ; i < _n_filters_in ; i++ ) {
-        for ( int j = 0 ; j < _n_filters_out ; j++ ) {
-            output[j] += conv2d(input[i], _weights[i][j], _stride);
+    // work is split by output filter, and by time tile when there are more threads than filters
+    const int n_threads = getIntraOpThreads();
+    const int n_tiles = n_threads > _n_filters_out ? (n_threads + _n_filters_out - 1) / _n_filters_out : 1;
+    const int tile_length = (n_frames_out + n_tiles - 1) / n_tiles;
+
+#pragma omp parallel for num_threads(n_threads) if(n_threads > 1) schedule(dynamic)
+    for ( int w = 0 ; w < _n_filters_out * n_tiles ; w++ ) {
+        int j = w / n_tiles;
+        int row_begin = (w % n_tiles) * tile_length;
+        int row_end = std::min(n_frames_out, row_begin + tile_length);
+        if ( row_begin >= row_end )
+            continue;
+        for ( int i = 0 ; i < _n_filters_in ; i++ ) {
+            output[j].middleRows(row_begin, row_end - row_begin) +=
+                conv2dRows(input[i], kernel(i, j), _stride, row_begin, row_end);
         }
     }
 
@@ -48,7 +180,7 @@ VecMatrixf Conv2D::forward_im2col( const VecMatrixf& input ) const {
     Matrixf input2cols = im2col(input, n_frames_out, _n_features_out, _kernel_size_time, _kernel_size_feature, _stride);
 
     // gemm
-    Matrixf output2cols = _weights_2cols * input2cols;
+    Matrixf output2cols = weights2cols() * input2cols;
 
     // add bias
     for ( int i = 0 ; i < _n_filters_out ; i++ ) {
@@ -69,19 +201,10 @@ void Conv2D::loadWeights( int& json_idx, const json& w_json ){
     _n_features_out = computeNFeaturesOut(_n_features_in, _kernel_size_feature, _stride);
 
     // shape of the Tensorflow weights json: ( kernel_size_time, kernel_size_feature, n_filters_in, n_filters_out )
-    // shape of _weights: ( n_filters_in, n_filters_out, kernel_size_time, kernel_size_feature )
-    // shape of _weights_2cols: ( n_filters_out, n_filters_in * kernel_size_time * kernel_size_feature )
+    // repacked into the blocked layout of _kernel, see kernelIndex
     const json& weights = w_json["weights"];
     auto layer_weights = weights.at(0);
-    _weights.resize( _n_filters_in );
-    _weights_2cols = Matrixf::Zero( _n_filters_out, _n_filters_in * _kernel_size_time * _kernel_size_feature );
-    
-    for ( size_t i = 0 ; i < _n_filters_in ; i++ ) {
-        _weights[i].resize( _n_filters_out );
-        for ( size_t j = 0 ; j < _n_filters_out ; j++ ) {
-            _weights[i][j] = Matrixf::Zero( _kernel_size_time, _kernel_size_feature );
-        }
-    }
+    std::shared_ptr<float> kernel( new float[kernelSize()], std::default_delete<float[]>() );
 
     for ( size_t i = 0 ; i < _kernel_size_time ; i++ ) {
         auto l1 = layer_weights.at(i);
@@ -90,13 +213,12 @@ void Conv2D::loadWeights( int& json_idx, const json& w_json ){
             for ( size_t k = 0 ; k < _n_filters_in ; k++ ) {
                 auto l3 = l2.at(k);
                 for ( size_t l = 0 ; l < _n_filters_out ; l++ ) {
-                    float w = l3.at(l).get<float>();
-                    _weights[k][l](i, j) = w;
-                    _weights_2cols(l, k * _kernel_size_time * _kernel_size_feature + i * _kernel_size_feature + j) = w;
+                    kernel.get()[kernelIndex(_n_filters_in, _n_filters_out, _kernel_size_time, _kernel_size_feature, k, l, i, j)] = l3.at(l).get<float>();
                 }
             }
         }
     }
+    _kernel = kernel;
 
     // bias should be of shape ( n_filters_out )
     auto layer_bias = weights.at(1);
@@ -117,8 +239,23 @@ void Conv2D::loadWeights( int& json_idx, const json& w_json ){
     }
 }
 
+Matrixf Conv2D::weights2cols() const {
+    const int kernel_length = _kernel_size_time * _kernel_size_feature;
+    Matrixf weights( _n_filters_out, _n_filters_in * kernel_length );
+    for ( int j = 0 ; j < _n_filters_out ; j++ )
+        for ( int i = 0 ; i < _n_filters_in ; i++ ) {
+            const Matrixf k = kernel(i, j);
+            weights.block(j, i * kernel_length, 1, kernel_length) = Eigen::Map<const Vectorf>( k.data(), kernel_length );
+        }
+    return weights;
+}
+
 VecVecMatrixf Conv2D::getWeights() const{
-    return _weights;
+    VecVecMatrixf weights( _n_filters_in, VecMatrixf( _n_filters_out ) );
+    for ( int i = 0 ; i < _n_filters_in ; i++ )
+        for ( int j = 0 ; j < _n_filters_out ; j++ )
+            weights[i][j] = kernel(i, j);
+    return weights;
 }
 
 ReLU::ReLU() : Layer(LayerType::RELU) {}
@@ -138,6 +275,11 @@ VecMatrixf ReLU::forward( const VecMatrixf& input ) const{
     return output;
 }
 
+void ReLU::forwardInPlace( VecMatrixf& x ) const {
+    for ( size_t i = 0 ; i < x.size() ; i++ )
+        x[i] = x[i].cwiseMax(0.0f);
+}
+
 Sigmoid::Sigmoid() : Layer(LayerType::SIGMOID) {}
 
 std::string Sigmoid::get_name() const{
@@ -160,6 +302,17 @@ VecMatrixf Sigmoid::forward( const VecMatrixf& input ) const{
     return output;
 }
 
+void Sigmoid::forwardInPlace( VecMatrixf& x ) const {
+    for ( size_t i = 0 ; i < x.size() ; i++ ) {
+        x[i] = x[i].unaryExpr( [] ( float v ) {
+            if ( v > 0 )
+                return 1.0f / (1.0f + std::exp(-v));
+            float exp_x = std::exp(v);
+            return exp_x / (1.0f + exp_x);
+        } );
+    }
+}
+
 BatchNorm::BatchNorm( int& json_idx, const json& weights ) : Layer(LayerType::BATCHNORM) {
     loadWeights( json_idx, weights );
 }
@@ -176,6 +329,12 @@ VecMatrixf BatchNorm::forward( const VecMatrixf& input ) const{
     return output;
 }
 
+void BatchNorm::forwardInPlace( VecMatrixf& x ) const {
+    for ( size_t i = 0 ; i < x.size() ; i++ ) {
+        x[i] = (x[i].array() - _mean[i]) * _multiplier[i] + _beta[i];
+    }
+}
+
 void BatchNorm::loadWeights( int& json_idx, const json& w_json ){
     
     const json& weights = w_json["weights"];
@@ -183,12 +342,25 @@ void BatchNorm::loadWeights( int& json_idx, const json& w_json ){
     _beta = weights.at(1).get<std::vector<float>>();
     _mean = weights.at(2).get<std::vector<float>>();
     _variance = weights.at(3).get<std::vector<float>>();
-    
+    computeMultiplier();
+
+    json_idx++;
+}
+
+BatchNorm::BatchNorm( int n_filters, const float* gamma, const float* beta, const float* mean, const float* variance ) :
+    Layer(LayerType::BATCHNORM),
+    _n_filters_in(n_filters),
+    _mean(mean, mean + n_filters),
+    _variance(variance, variance + n_filters),
+    _gamma(gamma, gamma + n_filters),
+    _beta(beta, beta + n_filters) {
+    computeMultiplier();
+}
+
+void BatchNorm::computeMultiplier() {
     // calculate multiplier
     _multiplier.resize(_gamma.size());
     for ( int i = 0 ; i < _gamma.size() ; i++ ) {
         _multiplier[i] = _gamma[i] / std::sqrt(_variance[i] + 0.001f);
     }
-
-    json_idx++;
 }
\ No newline at end of file
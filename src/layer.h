@@ -4,9 +4,13 @@
 #include "json.hpp"
 #include <string>
 #include <vector>
+#include <memory>
 
 using json = nlohmann::json;
 
+// output filters interleaved in the blocked Conv2D kernel layout, one SIMD register of floats
+inline constexpr int KERNEL_BLOCK = 8;
+
 enum LayerType {
     NONE,
     CONV2D,
@@ -20,12 +24,33 @@ class Layer {
 
         Layer(LayerType type) : type(type) {}
 
-        ~Layer() = default;
+        virtual ~Layer() = default;
 
         virtual std::string get_name() const = 0;
 
         virtual VecMatrixf forward( const VecMatrixf& input ) const = 0;
 
+        // write the result into output, reusing its matrices when their shapes match
+        // scratch is layer specific memory kept by the caller between calls
+        virtual void forwardInto( const VecMatrixf& input, VecMatrixf& output, VecMatrixf& scratch ) const {
+            output = forward( input );
+        }
+
+        // elementwise layers can overwrite their input
+        virtual bool inPlace() const { return false; }
+
+        virtual void forwardInPlace( VecMatrixf& x ) const {}
+
+        // incremental inference over time: input holds the next frames of a stream, output gets
+        // every frame that can be computed from the frames seen so far, history is the layer state
+        // between calls (empty at the start of the stream). flush marks the end of the stream
+        virtual void forwardStream( const VecMatrixf& input, VecMatrixf& output, VecMatrixf& history, bool flush ) const {
+            output = forward( input );
+        }
+
+        // frames of the future an output frame depends on
+        virtual int lookAhead() const { return 0; }
+
         LayerType type;
 };
 
@@ -34,22 +59,78 @@ class Conv2D : public Layer {
 
         Conv2D( int& json_idx, const json& weights );
 
+        // weights used in place, kernel is in the blocked layout ( see kernelIndex ) and shares the ownership
+        // of the memory it points into, e.g. a mapped model file
+        Conv2D( int n_filters_in, int n_filters_out, int n_features_in, int kernel_size_time, int kernel_size_feature,
+            int stride, std::shared_ptr<const float> kernel, const float* bias );
+
         std::string get_name() const override;
 
         VecMatrixf forward( const VecMatrixf& input ) const override;
 
-        void loadWeights( int& json_idx, const json& weights );
+        // scratch holds the zero padded input channels
+        void forwardInto( const VecMatrixf& input, VecMatrixf& output, VecMatrixf& scratch ) const override;
 
-        VecVecMatrixf getWeights() const;
+        // history keeps the last kernel_size_time - 1 (feature padded) input frames per channel
+        void forwardStream( const VecMatrixf& input, VecMatrixf& output, VecMatrixf& history, bool flush ) const override;
 
+        // bottom half of the 'same' padding in time
+        int lookAhead() const override { return _kernel_size_time - 1 - (_kernel_size_time - 1) / 2; }
 
-    private:
+        VecVecMatrixf getWeights() const;
+
+        int nFiltersIn() const { return _n_filters_in; }
+        int nFiltersOut() const { return _n_filters_out; }
+        int nFeaturesIn() const { return _n_features_in; }
+        int kernelSizeTime() const { return _kernel_size_time; }
+        int kernelSizeFeature() const { return _kernel_size_feature; }
+        int stride() const { return _stride; }
+        const float* kernelData() const { return _kernel.get(); }
+        size_t kernelSize() const { return static_cast<size_t>(_n_filters_out) * _n_filters_in * _kernel_size_time * _kernel_size_feature; }
+
+        // output filters per block of the kernel layout, KERNEL_BLOCK when they divide evenly, 1 otherwise
+        static int kernelBlock( int n_filters_out ) { return n_filters_out % KERNEL_BLOCK == 0 ? KERNEL_BLOCK : 1; }
+
+        // blocked kernel layout: ( n_filters_out / block, n_filters_in, kernel_size_time, kernel_size_feature, block )
+        // a block of output filters is interleaved, so one input value is multiplied with the whole block at once;
+        // with a block of 1 this is ( n_filters_out, n_filters_in, kernel_size_time, kernel_size_feature )
+        static size_t kernelIndex( int n_filters_in, int n_filters_out, int kernel_size_time, int kernel_size_feature,
+            int i, int j, int t, int f ) {
+            const int block = kernelBlock(n_filters_out);
+            return ( ( static_cast<size_t>( j / block ) * n_filters_in + i ) * kernel_size_time * kernel_size_feature
+                + t * kernel_size_feature + f ) * block + j % block;
+        }
+        const std::vector<float>& bias() const { return _bias; }
+
+    protected:
+
+        // only from the constructor, layers are immutable once built so that they can be shared
+        void loadWeights( int& json_idx, const json& weights );
 
         // different forward implementation
         VecMatrixf forward_naive( const VecMatrixf& input ) const;
 
         VecMatrixf forward_im2col( const VecMatrixf& input ) const;
 
+        // valid convolution over time of the padded channels, n_frames_out output frames
+        // overridden by the shape specialized StaticConv2D
+        virtual void convolvePadded( const VecMatrixf& padded, VecMatrixf& output, int n_frames_out ) const;
+
+        // convolvePadded for KERNEL_BLOCK output filters starting at j_begin
+        void convolveBlock( const VecMatrixf& padded, VecMatrixf& output, int j_begin, int row_begin, int row_end ) const;
+
+        typedef Eigen::Map<const Matrixf, 0, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>> KernelMap;
+
+        // kernel of input filter i and output filter j, shape: ( kernel_size_time, kernel_size_feature )
+        KernelMap kernel( int i, int j ) const {
+            const int block = kernelBlock(_n_filters_out);
+            return KernelMap( _kernel.get() + kernelIndex(_n_filters_in, _n_filters_out, _kernel_size_time, _kernel_size_feature, i, j, 0, 0),
+                _kernel_size_time, _kernel_size_feature, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(_kernel_size_feature * block, block) );
+        }
+
+        // im2col version of the kernel, shape: ( n_filters_out, n_filters_in * kernel_size_time * kernel_size_feature)
+        Matrixf weights2cols() const;
+
         int _n_filters_in;
         int _n_filters_out;
         int _n_features_in;
@@ -58,9 +139,8 @@ class Conv2D : public Layer {
         int _kernel_size_feature;
         int _stride;
 
-        VecVecMatrixf _weights;
-        // im2col version of weights, shape: ( n_filters_out, n_filters_in * kernel_size_time * kernel_size_feature)
-        Matrixf _weights_2cols;
+        // the only copy of the weights, in the blocked layout
+        std::shared_ptr<const float> _kernel;
         std::vector<float> _bias;
 
 };
@@ -74,6 +154,10 @@ class ReLU : public Layer {
 
         VecMatrixf forward( const VecMatrixf& input ) const override;
 
+        bool inPlace() const override { return true; }
+
+        void forwardInPlace( VecMatrixf& x ) const override;
+
 };
 
 class Sigmoid : public Layer {
@@ -85,6 +169,10 @@ class Sigmoid : public Layer {
 
         VecMatrixf forward( const VecMatrixf& input ) const override;
 
+        bool inPlace() const override { return true; }
+
+        void forwardInPlace( VecMatrixf& x ) const override;
+
 };
 
 class BatchNorm : public Layer {
@@ -96,9 +184,26 @@ class BatchNorm : public Layer {
 
         VecMatrixf forward( const VecMatrixf& input ) const override;
 
-        void loadWeights( int& json_idx, const json& weights );
+        bool inPlace() const override { return true; }
+
+        void forwardInPlace( VecMatrixf& x ) const override;
+
+        const std::vector<float>& gamma() const { return _gamma; }
+        const std::vector<float>& beta() const { return _beta; }
+        const std::vector<float>& mean() const { return _mean; }
+        const std::vector<float>& variance() const { return _variance; }
+
+        // parameters of n_filters channels, copied, so the caller need not keep them alive
+        BatchNorm( int n_filters, const float* gamma, const float* beta, const float* mean, const float* variance );
 
     private:
+
+        // only from the constructor, see Conv2D::loadWeights
+        void loadWeights( int& json_idx, const json& weights );
+
+        // _multiplier from gamma and variance
+        void computeMultiplier();
+
         int _n_filters_in;
         std::vector<float> _mean;
         std::vector<float> _variance;
@@ -1,45 +1,144 @@
 #pragma once
 
 #include "loader.h"
+#include "modelFile.h"
+#include "mappedFile.h"
+#ifdef EMBED_MODEL
+#include "embeddedModel.h"
+#endif
 #include "json.hpp"
 #include "cnpy.h"
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <stdexcept>
 
 using json = nlohmann::json;
 
-void loadDefaultKernel(Matrixcf &kernel) {
-    // load the precomputed kernel
-    cnpy::NpyArray arr = cnpy::npy_load("model/kernel.npy");
-    const size_t& n_bins = arr.shape[0];
-    const size_t& kernel_length = arr.shape[1];
-    std::complex<float>* data = const_cast<std::complex<float>*>(arr.data<std::complex<float>>());
-    kernel = Eigen::Map<Matrixcf>(data, n_bins, kernel_length);
+#ifdef EMBED_MODEL
+// the compiled-in model stands for the default directory only, any other directory is read from files
+inline bool useEmbeddedModel( const std::string& model_dir ) {
+    return model_dir == DEFAULT_MODEL_DIR;
 }
+#endif
 
-void loadDefaultLowPassFilter( Vectorf &filter_kernel) {
+std::shared_ptr<const std::complex<float>> mapDefaultKernel( int& n_bins, int& kernel_length, const std::string& model_dir ) {
+#ifdef EMBED_MODEL
+    // compiled into the binary, nothing to own
+    if ( useEmbeddedModel(model_dir) )
+        return std::shared_ptr<const std::complex<float>>(std::shared_ptr<void>(), getEmbeddedKernel(n_bins, kernel_length));
+#endif
+    // the precomputed kernel, used in place
+    const std::string path = model_dir + "/kernel.npy";
+    std::shared_ptr<const MappedFile> file = std::make_shared<const MappedFile>(path);
+    const uint8_t* data = file->data();
+
+    // npy format 1.0: magic, version, little endian header length, header, data
+    if ( file->size() < 10 || std::memcmp(data, "\x93NUMPY", 6) != 0 || data[6] != 1 )
+        throw std::runtime_error(path + " is not a npy 1.0 file");
+    const size_t header_len = data[8] | ( data[9] << 8 );
+    if ( 10 + header_len > file->size() )
+        throw std::runtime_error(path + ": truncated npy header");
+    const std::string header(reinterpret_cast<const char*>(data) + 10, header_len);
+
+    size_t word_size;
+    std::vector<size_t> shape;
+    bool fortran_order;
+    cnpy::parse_npy_header(const_cast<unsigned char*>(data), word_size, shape, fortran_order);
+    if ( header.find("'<c8'") == std::string::npos || fortran_order || shape.size() != 2 )
+        throw std::runtime_error(path + ": expected a C order complex64 matrix");
+    if ( 10 + header_len + shape[0] * shape[1] * sizeof(std::complex<float>) > file->size() )
+        throw std::runtime_error(path + ": truncated npy data");
+
+    n_bins = shape[0];
+    kernel_length = shape[1];
+    return std::shared_ptr<const std::complex<float>>(file, reinterpret_cast<const std::complex<float>*>(data + 10 + header_len));
+}
+
+void loadDefaultLowPassFilter( Vectorf &filter_kernel, const std::string& model_dir) {
+#ifdef EMBED_MODEL
+    if ( useEmbeddedModel(model_dir) ) {
+        getEmbeddedLowPassFilter(filter_kernel);
+        return;
+    }
+#endif
     // load the precomputed filter
-    cnpy::NpyArray arr = cnpy::npy_load("model/lowpass_filter.npy");
+    cnpy::NpyArray arr = cnpy::npy_load(model_dir + "/lowpass_filter.npy");
     const size_t& kernel_length = arr.shape[0];
     float* data = const_cast<float*>(arr.data<float>());
     filter_kernel = Eigen::Map<Vectorf>(data, kernel_length);
 }
 
-inline const std::string getModelPath( std::string model_name ) {
+const std::string getModelPath( std::string model_name, const std::string& model_dir ) {
     if (model_name == "Contour")
-        return "model/cnn_contour_model.json";
+        return model_dir + "/cnn_contour_model.json";
     else if (model_name == "Onset Input")
-        return "model/cnn_onset_1_model.json";
+        return model_dir + "/cnn_onset_1_model.json";
     else if (model_name == "Onset Output")
-        return "model/cnn_onset_2_model.json";
+        return model_dir + "/cnn_onset_2_model.json";
     else if (model_name == "Note")
-        return "model/cnn_note_model.json";
+        return model_dir + "/cnn_note_model.json";
     else
         return "Unknown model";
 }
 
-void getLayers( std::vector<Layer*>& layers, std::string model_name ) {
+inline bool endsWith( const std::string& s, const std::string& suffix ) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void getLayers( std::vector<Layer*>& layers, std::string model_name, const std::string& model_dir ) {
+#ifdef EMBED_MODEL
+    // weights compiled into the binary, no file access
+    if ( useEmbeddedModel(model_dir) && getEmbeddedLayers(layers, model_name) )
+        return;
+#endif
+
+    // prefer the converted binary model next to the json one, unless the json was changed after
+    // the conversion, the weights of the json are the reference
+    const std::string json_path = getModelPath(model_name, model_dir);
+    const std::string bin_path = json_path.substr(0, json_path.size() - 5) + ".bin";
+    // the time of each file is checked on its own: a binary model whose time cannot be read is
+    // skipped, one next to a json model whose time cannot be read is used
+    std::error_code ec;
+    if ( endsWith(json_path, ".json") && std::filesystem::exists(bin_path, ec) ) {
+        std::error_code bin_ec, json_ec;
+        const auto bin_time = std::filesystem::last_write_time(bin_path, bin_ec);
+        const auto json_time = std::filesystem::last_write_time(json_path, json_ec);
+        // one write per message, the parts of amtWeights may load in parallel
+        if ( !bin_ec && ( json_ec || bin_time >= json_time ) ) {
+            // a binary model of another format version falls back to the json model like a stale one,
+            // the version is checked before any layer is created
+            try {
+                loadLayers(layers, bin_path);
+                return;
+            }
+            catch ( const ModelFileVersionError& e ) {
+                const std::string message = std::string("Ignoring ") + e.what() + ", regenerate it with convert_model\n";
+                std::cerr << message;
+            }
+        }
+        else if ( !bin_ec ) {
+            const std::string message = "Ignoring " + bin_path + ", it is older than " + json_path
+                + ", regenerate it with convert_model\n";
+            std::cerr << message;
+        }
+    }
+    loadLayers(layers, json_path);
+}
+
+void loadLayers( std::vector<Layer*>& layers, const std::string& path ) {
+    if ( endsWith(path, ".json") )
+        loadJsonLayers(layers, path);
+    else
+        loadModelFile(layers, path);
+}
+
+void loadJsonLayers( std::vector<Layer*>& layers, const std::string& path ) {
     // load the model
-    std::ifstream f(getModelPath(model_name));
+    std::ifstream f(path);
+    if ( !f )
+        throw std::runtime_error("cannot open model file " + path);
     json w_json = json::parse(f);
 
     int json_idx = 0;
@@ -85,43 +184,6 @@ void getLayers( std::vector<Layer*>& layers, std::string model_name ) {
     f.close();
 }
 
-// support conv2d only for now
-void loadWeights( const std::vector<Layer*>& layers, std::string model_name ) {
-    // load the model
-    std::ifstream f(getModelPath(model_name));
-    json w_json = json::parse(f);
-
-    int json_idx = 0, layer_idx = 0;
-    // load the weights
-    auto json_layers = w_json["layers"];
-    while( json_idx < json_layers.size() ) {
-        auto layer_json = json_layers.at(json_idx);
-        std::string layer_type = layer_json["type"].get<std::string>();
-
-        if ( layer_type == "conv2d" ) {
-            // find the corresponding layer
-            while( layer_idx < layers.size() && layers[layer_idx]->type != LayerType::CONV2D  ) {
-                layer_idx++;
-            }
-            dynamic_cast<Conv2D*>(layers[layer_idx])->loadWeights(json_idx, layer_json);
-            if ( layer_json.contains("activation") ) {
-                std::string activation = layer_json["activation"].get<std::string>();
-                if ( activation == "relu" ) {
-                    json_idx++;
-                }
-                else if ( activation == "sigmoid" ) {
-                    json_idx++;
-                }
-                else {
-                    std::cout << "Unknown activation function: " << activation << std::endl;
-                }
-            }
-        }
-    }
-
-    f.close();
-}
-
 Vectorf getExampleAudio() {
     // load the example audio
     cnpy::NpyArray arr = cnpy::npy_load("data/Undertale-Megalovania.npy");
@@ -2,15 +2,28 @@
 
 #include "typedef.h"
 #include "layer.h"
+#include "constant.h"
+#include <complex>
+#include <memory>
 #include <vector>
 #include <string>
 
-void loadDefaultKernel(Matrixcf &kernel);
+// the precomputed CQT kernel mapped from model_dir/kernel.npy, shape ( n_bins, kernel_length )
+// the pointer shares the ownership of the mapping
+std::shared_ptr<const std::complex<float>> mapDefaultKernel(int& n_bins, int& kernel_length, const std::string& model_dir = DEFAULT_MODEL_DIR);
 
-void loadDefaultLowPassFilter( Vectorf &filter_kernel);
+void loadDefaultLowPassFilter( Vectorf &filter_kernel, const std::string& model_dir = DEFAULT_MODEL_DIR);
 
-void getLayers(std::vector<Layer*> &layers, std::string model_name);
+// path of the json weights of a model, e.g. model/cnn_contour_model.json for "Contour"
+const std::string getModelPath(std::string model_name, const std::string& model_dir = DEFAULT_MODEL_DIR);
 
-void loadWeights(const std::vector<Layer*> &layers, std::string model_name);
+// layers of a model by name, from the binary model file next to its json file when there is one,
+// it is not older than the json file and of the current MODEL_FILE_VERSION
+void getLayers(std::vector<Layer*> &layers, std::string model_name, const std::string& model_dir = DEFAULT_MODEL_DIR);
+
+// layers from a json or, for any other extension, a binary model file
+void loadLayers(std::vector<Layer*> &layers, const std::string& path);
+
+void loadJsonLayers(std::vector<Layer*> &layers, const std::string& path);
 
 Vectorf getExampleAudio();
\ No newline at end of file
@@ -1,24 +1,122 @@
 #include "amtModel.h"
+#include "batchTranscriber.h"
 #include "loader.h"
+#include "midi.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <string>
+#include <vector>
 
 void printRunStats() {
     // Eigen number of threads
     std::cout << "Eigen number of threads: " << Eigen::nbThreads() << std::endl;
 }
 
+void printUsage( const char* name ) {
+    std::cout << "Usage: " << name << " [options] <input>...\n"
+        "  input: a WAV file, a directory searched recursively for WAV files, or @list.txt with one path per line\n"
+        "  -o DIR   write the outputs to DIR instead of next to the inputs\n"
+        "  -t FMT   output formats, comma separated: midi, notes (default midi)\n"
+        "  -j N     worker threads (default OMP_NUM_THREADS or the number of cores)\n"
+        "  -k N     files in flight at once (default twice the worker threads)\n"
+        "  -m DIR   model directory (default " << DEFAULT_MODEL_DIR << ")\n"
+        "  -c DIR   cache of the transcriptions, files transcribed before by the same model are not run again\n"
+        "  -s MB    size cap of the cache, the least recently used entries are removed (default no cap)\n"
+        "  -q       no per-file report\n"
+        "without inputs the example audio is transcribed, its MIDI file is written to the directory given by -o\n";
+}
+
 int main(int argc, char** argv) {
 
     // printRunStats();
 
-    // Load the example audio
-    auto audio = getExampleAudio();
+    BatchConfig config;
+    ModelConfig model_config;
+    int n_threads = getNumThreads();
+    bool quiet = false;
+    std::string cache_dir;
+    uint64_t cache_max_bytes = 0;
+    std::vector<std::string> inputs;
+
+    for ( int i = 1 ; i < argc ; i++ ) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if ( arg == "-h" || arg == "--help" ) {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else if ( arg == "-o" && has_value )
+            config.output_dir = argv[++i];
+        else if ( arg == "-t" && has_value ) {
+            const std::string formats = argv[++i];
+            config.write_midi = formats.find("midi") != std::string::npos;
+            config.write_notes = formats.find("notes") != std::string::npos;
+        }
+        else if ( arg == "-j" && has_value )
+            n_threads = std::atoi(argv[++i]);
+        else if ( arg == "-k" && has_value )
+            config.max_in_flight = std::atoi(argv[++i]);
+        else if ( arg == "-m" && has_value )
+            model_config.model_dir = argv[++i];
+        else if ( arg == "-c" && has_value )
+            cache_dir = argv[++i];
+        else if ( arg == "-s" && has_value )
+            cache_max_bytes = static_cast<uint64_t>(std::atof(argv[++i]) * 1024 * 1024);
+        else if ( arg == "-q" )
+            quiet = true;
+        else if ( arg.size() > 1 && arg[0] == '-' ) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        else
+            inputs.push_back(arg);
+    }
 
     // Initialize the model
-    auto model = amtModel();
+    auto model = amtModel(amtWeights::shared(model_config), std::make_shared<ThreadPool>(n_threads));
+    if ( !cache_dir.empty() )
+        model.setCache(std::make_shared<TranscriptionCache>(cache_dir, 1, cache_max_bytes));
+
+    if ( inputs.empty() ) {
+        // Load the example audio
+        auto audio = getExampleAudio();
 
-    // Transcribe the audio
-    auto notes = model.transcribeAudio(audio);
+        // Transcribe the audio
+        auto notes = model.transcribeAudio(audio);
 
-    return 0;
-}
\ No newline at end of file
+        // Write the MIDI file if an output directory is given
+        if ( !config.output_dir.empty() ) {
+            std::filesystem::create_directories(config.output_dir);
+            writeMidi(notes, batchOutputPath("Undertale-Megalovania", config.output_dir, ".mid"));
+        }
+        return 0;
+    }
+
+    const std::vector<std::string> files = collectInputFiles(inputs);
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<BatchResult> results = transcribeBatch(model, files, config, [quiet] ( const BatchResult& result ) {
+        if ( !result.error.empty() )
+            std::fprintf(stderr, "%s: error: %s\n", result.path.c_str(), result.error.c_str());
+        else if ( !quiet )
+            std::printf("%s: %.2f s audio, %d notes, %.3f s (decode %.3f s), %.1fx realtime%s\n", result.path.c_str(),
+                result.audio_seconds, result.n_notes, result.wall_seconds, result.decode_seconds, result.throughput(),
+                result.cached ? ", cached" : "");
+    });
+    const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double audio_seconds = 0.0;
+    int n_failed = 0, n_cached = 0;
+    for ( const BatchResult& result : results ) {
+        audio_seconds += result.audio_seconds;
+        n_failed += !result.error.empty();
+        n_cached += result.cached;
+    }
+    std::printf("%zu files (%d failed, %d cached), %.1f s audio in %.2f s, %.1fx realtime, %.1f files/s\n", results.size(), n_failed, n_cached,
+        audio_seconds, wall_seconds, wall_seconds > 0.0 ? audio_seconds / wall_seconds : 0.0,
+        wall_seconds > 0.0 ? results.size() / wall_seconds : 0.0);
+
+    return n_failed > 0 ? 1 : 0;
+}
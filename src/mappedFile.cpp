@@ -0,0 +1,49 @@
+#include "mappedFile.h"
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile( const std::string& path ) : _path(path), _data(nullptr), _size(0), _mapped(false) {
+#ifdef USE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if ( fd < 0 )
+        throw std::runtime_error("cannot open " + path);
+    struct stat st;
+    if ( fstat(fd, &st) == 0 && st.st_size > 0 ) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if ( addr != MAP_FAILED ) {
+            _data = static_cast<const uint8_t*>(addr);
+            _size = st.st_size;
+            _mapped = true;
+        }
+    }
+    close(fd);
+#endif
+
+    if ( !_mapped ) {
+        std::ifstream f(path, std::ios::binary | std::ios::ate);
+        if ( !f )
+            throw std::runtime_error("cannot open " + path);
+        _size = f.tellg();
+        _buffer.resize((_size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+        f.seekg(0);
+        f.read(reinterpret_cast<char*>(_buffer.data()), _size);
+        if ( !f )
+            throw std::runtime_error("cannot read " + path);
+        _data = reinterpret_cast<const uint8_t*>(_buffer.data());
+    }
+}
+
+MappedFile::~MappedFile() {
+#ifdef USE_MMAP
+    if ( _mapped )
+        munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+}
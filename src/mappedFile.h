@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// read only contents of a file, mapped with MAP_SHARED when mmap is available, so every process
+// mapping the same file shares one physical copy through the page cache, and read into memory otherwise
+// throws std::runtime_error when the file can not be read
+class MappedFile {
+    public:
+
+        MappedFile( const std::string& path );
+
+        ~MappedFile();
+
+        MappedFile( const MappedFile& ) = delete;
+        MappedFile& operator=( const MappedFile& ) = delete;
+
+        const uint8_t* data() const { return _data; }
+
+        size_t size() const { return _size; }
+
+        bool mapped() const { return _mapped; }
+
+        const std::string& path() const { return _path; }
+
+    private:
+
+        std::string _path;
+        const uint8_t* _data;
+        size_t _size;
+        bool _mapped;
+        // fallback when mmap is not available, 8 byte aligned
+        std::vector<uint64_t> _buffer;
+};
@@ -0,0 +1,193 @@
+#include "midi.h"
+#include "constant.h"
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <cmath>
+
+enum MidiEventType : uint8_t {
+    NOTE_OFF = 0x80,
+    NOTE_ON = 0x90,
+    PITCH_WHEEL = 0xE0
+};
+
+// order of events sharing a tick: note off, last bend of the ending note,
+// pitch wheel reset, bends of the starting note, note on
+enum MidiEventOrder : uint8_t {
+    ORDER_NOTE_OFF,
+    ORDER_BEND_END,
+    ORDER_BEND_RESET,
+    ORDER_BEND,
+    ORDER_NOTE_ON
+};
+
+struct MidiEvent {
+    uint32_t tick;
+    uint8_t order;
+    uint8_t type;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+inline uint32_t time2Tick( float time, float ticks_per_second ) {
+    return static_cast<uint32_t>( std::max( 0.0f, std::round( time * ticks_per_second ) ) );
+}
+
+static void appendNoteEvents( std::vector<MidiEvent>& events, float ticks_per_second,
+    float start_time, float end_time, int pitch, float amplitude,
+    const int* bends, int n_bends ) {
+
+    uint8_t key = static_cast<uint8_t>( std::clamp( pitch, 0, 127 ) );
+    uint8_t velocity = static_cast<uint8_t>( std::clamp( static_cast<int>( std::round( amplitude * 127 ) ), 1, 127 ) );
+    uint32_t start_tick = time2Tick( start_time, ticks_per_second );
+    uint32_t end_tick = time2Tick( end_time, ticks_per_second );
+    events.push_back( { start_tick, ORDER_NOTE_ON, NOTE_ON, key, velocity } );
+    events.push_back( { end_tick, ORDER_NOTE_OFF, NOTE_OFF, key, 0 } );
+
+    // same as basic_pitch note2midi, bends are spread linearly over the note
+    for ( int i = 0 ; i < n_bends ; i++ ) {
+        float t = n_bends > 1 ? start_time + ( end_time - start_time ) * i / ( n_bends - 1 ) : start_time;
+        uint32_t tick = time2Tick( t, ticks_per_second );
+        int value = static_cast<int>( std::round( bends[i] * 4096.0f / CONTOURS_BINS_PER_SEMITONE ) );
+        value = std::clamp( value, -N_PITCH_BEND_TICKS, N_PITCH_BEND_TICKS - 1 ) + N_PITCH_BEND_TICKS;
+        events.push_back( { tick, static_cast<uint8_t>( tick == end_tick ? ORDER_BEND_END : ORDER_BEND ), PITCH_WHEEL,
+            static_cast<uint8_t>( value & 0x7F ), static_cast<uint8_t>( ( value >> 7 ) & 0x7F ) } );
+    }
+
+    // center the wheel so the next note on the channel starts unbent
+    if ( n_bends > 0 )
+        events.push_back( { end_tick, ORDER_BEND_RESET, PITCH_WHEEL,
+            static_cast<uint8_t>( N_PITCH_BEND_TICKS & 0x7F ), static_cast<uint8_t>( N_PITCH_BEND_TICKS >> 7 ) } );
+}
+
+// same as basic_pitch drop_overlapping_pitch_bends, all notes share channel 0
+// so the pitch wheel of a note overlapping another one would bend both
+static std::vector<bool> overlappingNotes( const std::vector<float>& start_time, const std::vector<float>& end_time ) {
+
+    const size_t n_notes = start_time.size();
+    std::vector<size_t> order( n_notes );
+    for ( size_t i = 0 ; i < n_notes ; i++ )
+        order[i] = i;
+    std::stable_sort( order.begin(), order.end(), [&] ( size_t a, size_t b ) {
+        return start_time[a] < start_time[b];
+    } );
+
+    std::vector<bool> overlapping( n_notes, false );
+    for ( size_t i = 0 ; i < n_notes ; i++ ) {
+        for ( size_t j = i + 1 ; j < n_notes && start_time[order[j]] < end_time[order[i]] ; j++ ) {
+            overlapping[order[i]] = true;
+            overlapping[order[j]] = true;
+        }
+    }
+    return overlapping;
+}
+
+inline void writeBigEndian( std::string& buf, uint32_t value, int n_bytes ) {
+    for ( int i = n_bytes - 1 ; i >= 0 ; i-- )
+        buf.push_back( static_cast<char>( ( value >> ( 8 * i ) ) & 0xFF ) );
+}
+
+inline void writeVarLen( std::string& buf, uint32_t value ) {
+    char bytes[5];
+    int n = 0;
+    bytes[n++] = value & 0x7F;
+    while ( value >>= 7 )
+        bytes[n++] = ( value & 0x7F ) | 0x80;
+    while ( n > 0 )
+        buf.push_back( bytes[--n] );
+}
+
+static void writeSMF( std::vector<MidiEvent>& events, const std::string& path, float midi_tempo ) {
+
+    std::stable_sort( events.begin(), events.end(), [] ( const MidiEvent& a, const MidiEvent& b ) {
+        if ( a.tick != b.tick )
+            return a.tick < b.tick;
+        return a.order < b.order;
+    } );
+
+    std::string track;
+    track.reserve( events.size() * 4 + 32 );
+
+    // tempo meta event, microseconds per quarter note
+    writeVarLen( track, 0 );
+    track += "\xFF\x51\x03";
+    writeBigEndian( track, static_cast<uint32_t>( std::round( 60000000.0f / midi_tempo ) ), 3 );
+
+    // program change to acoustic grand piano on channel 0
+    writeVarLen( track, 0 );
+    track.push_back( '\xC0' );
+    track.push_back( '\x00' );
+
+    uint32_t last_tick = 0;
+    for ( const MidiEvent& e : events ) {
+        writeVarLen( track, e.tick - last_tick );
+        track.push_back( static_cast<char>( e.type ) );
+        track.push_back( static_cast<char>( e.data1 ) );
+        track.push_back( static_cast<char>( e.data2 ) );
+        last_tick = e.tick;
+    }
+
+    // end of track
+    writeVarLen( track, 0 );
+    track += std::string( "\xFF\x2F\x00", 3 );
+
+    std::string header = "MThd";
+    writeBigEndian( header, 6, 4 );
+    writeBigEndian( header, 0, 2 ); // format 0
+    writeBigEndian( header, 1, 2 ); // 1 track
+    writeBigEndian( header, MIDI_RESOLUTION, 2 );
+    header += "MTrk";
+    writeBigEndian( header, track.size(), 4 );
+
+    std::ofstream f( path, std::ios::binary );
+    if ( !f )
+        throw std::runtime_error( "Cannot open " + path + " for writing" );
+    f.write( header.data(), header.size() );
+    f.write( track.data(), track.size() );
+}
+
+void writeMidi( const std::vector<Note>& notes, const std::string& path,
+    const float midi_tempo, const bool include_pitch_bends ) {
+
+    std::vector<bool> overlapping( notes.size(), false );
+    if ( include_pitch_bends ) {
+        std::vector<float> start_time( notes.size() ), end_time( notes.size() );
+        for ( size_t i = 0 ; i < notes.size() ; i++ ) {
+            start_time[i] = notes[i].start_time;
+            end_time[i] = notes[i].end_time;
+        }
+        overlapping = overlappingNotes( start_time, end_time );
+    }
+
+    const float ticks_per_second = midi_tempo / 60.0f * MIDI_RESOLUTION;
+    std::vector<MidiEvent> events;
+    events.reserve( notes.size() * 2 );
+    for ( size_t i = 0 ; i < notes.size() ; i++ ) {
+        const Note& note = notes[i];
+        int n_bends = include_pitch_bends && !overlapping[i] ? note.bends.size() : 0;
+        appendNoteEvents( events, ticks_per_second,
+            note.start_time, note.end_time, note.pitch, note.amplitude,
+            note.bends.data(), n_bends );
+    }
+    writeSMF( events, path, midi_tempo );
+}
+
+void writeMidi( const NoteArray& notes, const std::string& path,
+    const float midi_tempo, const bool include_pitch_bends ) {
+
+    std::vector<bool> overlapping = include_pitch_bends
+        ? overlappingNotes( notes.start_time, notes.end_time )
+        : std::vector<bool>( notes.size(), false );
+
+    const float ticks_per_second = midi_tempo / 60.0f * MIDI_RESOLUTION;
+    std::vector<MidiEvent> events;
+    events.reserve( notes.size() * 3 + ( include_pitch_bends ? notes.bends.size() : 0 ) );
+    for ( size_t i = 0 ; i < notes.size() ; i++ ) {
+        int n_bends = notes.bend_offsets[i + 1] - notes.bend_offsets[i];
+        appendNoteEvents( events, ticks_per_second,
+            notes.start_time[i], notes.end_time[i], notes.pitch[i], notes.amplitude[i],
+            notes.bends.data() + notes.bend_offsets[i], include_pitch_bends && !overlapping[i] ? n_bends : 0 );
+    }
+    writeSMF( events, path, midi_tempo );
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "note.h"
+#include <vector>
+#include <string>
+
+// default tempo used by note2midi in python/midi_utils.py
+inline constexpr float MIDI_TEMPO = 115.0f;
+
+// ticks per quarter note, same as pretty_midi
+inline constexpr int MIDI_RESOLUTION = 220;
+
+// pitch wheel range is +-2 semitones
+inline constexpr int N_PITCH_BEND_TICKS = 8192;
+
+// write notes as a single track Standard MIDI File (format 0)
+// velocity = amplitude * 127, bends are written as pitch wheel events spread over the note
+// and the wheel is centered again at note off, bends of overlapping notes are dropped
+void writeMidi( const std::vector<Note>& notes, const std::string& path,
+    const float midi_tempo = MIDI_TEMPO, const bool include_pitch_bends = true );
+
+void writeMidi( const NoteArray& notes, const std::string& path,
+    const float midi_tempo = MIDI_TEMPO, const bool include_pitch_bends = true );
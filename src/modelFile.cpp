@@ -0,0 +1,160 @@
+#include "modelFile.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+uint64_t fnv1a( const uint8_t* data, size_t n, uint64_t hash ) {
+    for ( size_t i = 0 ; i < n ; i++ ) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+ModelFile::ModelFile( const std::string& path ) : _file(path) {
+    validate();
+}
+
+void ModelFile::validate() const {
+    const std::string& path = _file.path();
+    const uint8_t* data = _file.data();
+    const size_t size = _file.size();
+    if ( size < sizeof(ModelFileHeader) || std::memcmp(header().magic, MODEL_FILE_MAGIC, sizeof(MODEL_FILE_MAGIC)) != 0 )
+        throw std::runtime_error(path + " is not a model file");
+    if ( header().version != MODEL_FILE_VERSION )
+        throw ModelFileVersionError(path, header().version);
+    if ( header().file_size != size )
+        throw std::runtime_error(path + ": truncated model file");
+    if ( fnv1a(data + sizeof(ModelFileHeader), size - sizeof(ModelFileHeader)) != header().checksum )
+        throw std::runtime_error(path + ": model file checksum mismatch");
+    if ( sizeof(ModelFileHeader) + header().n_layers * sizeof(ModelLayerRecord) > size )
+        throw std::runtime_error(path + ": truncated layer table");
+
+    // blob bounds
+    for ( int i = 0 ; i < numLayers() ; i++ ) {
+        const ModelLayerRecord& r = layer(i);
+        if ( r.type == LayerType::CONV2D ) {
+            if ( r.n_filters_out <= 0 || r.kernel_block != Conv2D::kernelBlock(r.n_filters_out) )
+                throw std::runtime_error(path + ": unexpected kernel layout, convert the model again");
+            floats(r.offsets[0], static_cast<size_t>(r.n_filters_out) * r.n_filters_in * r.kernel_size_time * r.kernel_size_feature);
+            floats(r.offsets[1], r.n_filters_out);
+        }
+        else if ( r.type == LayerType::BATCHNORM ) {
+            for ( int j = 0 ; j < 4 ; j++ )
+                floats(r.offsets[j], r.n_filters_in);
+        }
+        else if ( r.type != LayerType::RELU && r.type != LayerType::SIGMOID ) {
+            throw std::runtime_error(path + ": unknown layer type " + std::to_string(r.type));
+        }
+    }
+}
+
+const ModelLayerRecord& ModelFile::layer( int idx ) const {
+    return reinterpret_cast<const ModelLayerRecord*>(_file.data() + sizeof(ModelFileHeader))[idx];
+}
+
+const float* ModelFile::floats( uint64_t offset, size_t n ) const {
+    const size_t size = _file.size();
+    if ( offset % sizeof(float) != 0 || offset < sizeof(ModelFileHeader) || offset > size || n > (size - offset) / sizeof(float) )
+        throw std::runtime_error(_file.path() + ": blob out of bounds");
+    return reinterpret_cast<const float*>(_file.data() + offset);
+}
+
+void loadModelFile( std::vector<Layer*>& layers, const std::string& path ) {
+    std::shared_ptr<const ModelFile> file = std::make_shared<const ModelFile>(path);
+
+    for ( int i = 0 ; i < file->numLayers() ; i++ ) {
+        const ModelLayerRecord& r = file->layer(i);
+        switch ( r.type ) {
+            case LayerType::CONV2D: {
+                const float* kernel = file->floats(r.offsets[0], 0);
+                // the kernel keeps the file alive
+                layers.emplace_back(new Conv2D(r.n_filters_in, r.n_filters_out, r.n_features_in, r.kernel_size_time,
+                    r.kernel_size_feature, r.stride, std::shared_ptr<const float>(file, kernel), file->floats(r.offsets[1], 0)));
+                break;
+            }
+            case LayerType::RELU:
+                layers.emplace_back(new ReLU());
+                break;
+            case LayerType::SIGMOID:
+                layers.emplace_back(new Sigmoid());
+                break;
+            case LayerType::BATCHNORM:
+                layers.emplace_back(new BatchNorm(r.n_filters_in, file->floats(r.offsets[0], 0), file->floats(r.offsets[1], 0),
+                    file->floats(r.offsets[2], 0), file->floats(r.offsets[3], 0)));
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// append n floats to the blob area at the next aligned offset
+inline uint64_t appendBlob( std::vector<uint8_t>& bytes, const float* data, size_t n ) {
+    size_t offset = ( bytes.size() + MODEL_FILE_ALIGNMENT - 1 ) / MODEL_FILE_ALIGNMENT * MODEL_FILE_ALIGNMENT;
+    bytes.resize(offset + n * sizeof(float));
+    std::memcpy(bytes.data() + offset, data, n * sizeof(float));
+    return offset;
+}
+
+void writeModelFile( const std::vector<Layer*>& layers, const std::string& path ) {
+    const size_t table_end = sizeof(ModelFileHeader) + layers.size() * sizeof(ModelLayerRecord);
+    std::vector<uint8_t> bytes(table_end, 0);
+    std::vector<ModelLayerRecord> records(layers.size());
+
+    for ( size_t i = 0 ; i < layers.size() ; i++ ) {
+        ModelLayerRecord& r = records[i];
+        std::memset(&r, 0, sizeof(r));
+        r.type = layers[i]->type;
+
+        if ( const Conv2D* conv = dynamic_cast<const Conv2D*>(layers[i]) ) {
+            r.n_filters_in = conv->nFiltersIn();
+            r.n_filters_out = conv->nFiltersOut();
+            r.n_features_in = conv->nFeaturesIn();
+            r.kernel_size_time = conv->kernelSizeTime();
+            r.kernel_size_feature = conv->kernelSizeFeature();
+            r.stride = conv->stride();
+            r.kernel_block = Conv2D::kernelBlock(r.n_filters_out);
+            r.offsets[0] = appendBlob(bytes, conv->kernelData(), conv->kernelSize());
+            r.offsets[1] = appendBlob(bytes, conv->bias().data(), conv->bias().size());
+        }
+        else if ( const BatchNorm* bn = dynamic_cast<const BatchNorm*>(layers[i]) ) {
+            r.n_filters_in = bn->gamma().size();
+            r.offsets[0] = appendBlob(bytes, bn->gamma().data(), bn->gamma().size());
+            r.offsets[1] = appendBlob(bytes, bn->beta().data(), bn->beta().size());
+            r.offsets[2] = appendBlob(bytes, bn->mean().data(), bn->mean().size());
+            r.offsets[3] = appendBlob(bytes, bn->variance().data(), bn->variance().size());
+        }
+    }
+    std::memcpy(bytes.data() + sizeof(ModelFileHeader), records.data(), records.size() * sizeof(ModelLayerRecord));
+
+    ModelFileHeader header;
+    std::memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(MODEL_FILE_MAGIC));
+    header.version = MODEL_FILE_VERSION;
+    header.n_layers = layers.size();
+    header.reserved = 0;
+    header.file_size = bytes.size();
+    header.checksum = fnv1a(bytes.data() + sizeof(ModelFileHeader), bytes.size() - sizeof(ModelFileHeader));
+    std::memcpy(bytes.data(), &header, sizeof(header));
+
+    // the file may be mapped by running processes, truncating it in place would pull the weights
+    // from under them, so write a new file and rename it over the old one
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream f(tmp_path, std::ios::binary);
+        f.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        f.close();
+        if ( !f ) {
+            std::remove(tmp_path.c_str());
+            throw std::runtime_error("cannot write model file " + path);
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tmp_path, path, error);
+    if ( error ) {
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error("cannot write model file " + path + ": " + error.message());
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "layer.h"
+#include "mappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// binary model format, written by writeModelFile and used in place after mmap
+// layout: ModelFileHeader, n_layers ModelLayerRecord, then the float blobs, each aligned to MODEL_FILE_ALIGNMENT
+// Conv2D kernels are stored in the blocked layout of Conv2D, see Conv2D::kernelIndex
+// all values in the byte order of the host, the checksum rejects files written on a host with another byte order
+
+inline constexpr char MODEL_FILE_MAGIC[4] = { 'B', 'P', 'C', 'N' };
+inline constexpr uint32_t MODEL_FILE_VERSION = 2;
+inline constexpr size_t MODEL_FILE_ALIGNMENT = 64;
+
+// thrown for a model file of another MODEL_FILE_VERSION, regenerate it with convert_model
+struct ModelFileVersionError : std::runtime_error {
+    ModelFileVersionError( const std::string& path, uint32_t version ) :
+        std::runtime_error(path + ": unsupported model file version " + std::to_string(version)) {}
+};
+
+struct ModelFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t n_layers;
+    uint32_t reserved;
+    uint64_t file_size;
+    // FNV-1a over all bytes after the header
+    uint64_t checksum;
+};
+
+struct ModelLayerRecord {
+    // LayerType
+    uint32_t type;
+    int32_t n_filters_in;
+    int32_t n_filters_out;
+    int32_t n_features_in;
+    int32_t kernel_size_time;
+    int32_t kernel_size_feature;
+    int32_t stride;
+    // output filters per block of the kernel layout, Conv2D::kernelBlock
+    int32_t kernel_block;
+    // byte offsets of the blobs, 0 when unused
+    // Conv2D: kernel, bias; BatchNorm: gamma, beta, mean, variance over n_filters_in channels
+    uint64_t offsets[4];
+};
+
+static_assert( sizeof(ModelFileHeader) == 32, "unexpected padding in ModelFileHeader" );
+static_assert( sizeof(ModelLayerRecord) == 64, "unexpected padding in ModelLayerRecord" );
+
+// a validated model file, see MappedFile
+// throws std::runtime_error when the file can not be read or is not a valid model file
+class ModelFile {
+    public:
+
+        ModelFile( const std::string& path );
+
+        int numLayers() const { return header().n_layers; }
+
+        const ModelLayerRecord& layer( int idx ) const;
+
+        // n floats at offset, checked against the file size
+        const float* floats( uint64_t offset, size_t n ) const;
+
+        size_t size() const { return _file.size(); }
+
+        bool mapped() const { return _file.mapped(); }
+
+    private:
+
+        const ModelFileHeader& header() const { return *reinterpret_cast<const ModelFileHeader*>(_file.data()); }
+
+        // check magic, version, size, checksum and the blobs of every layer
+        void validate() const;
+
+        MappedFile _file;
+};
+
+// FNV-1a 64 bit hash
+uint64_t fnv1a( const uint8_t* data, size_t n, uint64_t hash = 0xcbf29ce484222325ull );
+
+// append the layers stored in the model file at path, the weights of the Conv2D layers stay in the file
+void loadModelFile( std::vector<Layer*>& layers, const std::string& path );
+
+// write the layers in the binary model format, through a temporary file renamed over path so that
+// processes mapping the old file keep their weights
+void writeModelFile( const std::vector<Layer*>& layers, const std::string& path );
@@ -0,0 +1,85 @@
+#include "modelHandle.h"
+#include "constant.h"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+ModelHandle::ModelHandle( std::shared_ptr<const amtWeights> weights ) :
+    _snapshot(std::make_shared<const Snapshot>(Snapshot{ weights, 1 })) {
+    if ( !weights )
+        throw std::invalid_argument("ModelHandle: no weights");
+}
+
+ModelHandle::ModelHandle( const ModelConfig& config ) :
+    ModelHandle(amtWeights::shared(config)) {
+}
+
+ModelHandle::~ModelHandle() {
+    std::unique_lock<std::mutex> lock(_reload_mutex);
+    _reload_cv.wait(lock, [this] { return _n_reloading == 0; });
+}
+
+std::shared_ptr<const amtWeights> ModelHandle::get() const {
+    return std::atomic_load(&_snapshot)->weights;
+}
+
+uint64_t ModelHandle::version() const {
+    return std::atomic_load(&_snapshot)->version;
+}
+
+uint64_t ModelHandle::reload( ModelConfig config ) {
+    // everything is loaded here, not by the first request on the new version
+    config.lazy = false;
+    return swap(std::make_shared<const amtWeights>(config));
+}
+
+std::future<uint64_t> ModelHandle::reloadAsync( const ModelConfig& config ) {
+    {
+        std::lock_guard<std::mutex> lock(_reload_mutex);
+        _n_reloading++;
+    }
+    return std::async(std::launch::async, [this, config] {
+        // signals the destructor when the reload returned or threw, the handle is not used after that
+        struct Finished {
+            ModelHandle* handle;
+            ~Finished() {
+                std::lock_guard<std::mutex> lock(handle->_reload_mutex);
+                handle->_n_reloading--;
+                handle->_reload_cv.notify_all();
+            }
+        } finished{ this };
+        return reload(config);
+    });
+}
+
+uint64_t ModelHandle::swap( std::shared_ptr<const amtWeights> weights ) {
+    if ( !weights )
+        throw std::invalid_argument("ModelHandle: no weights");
+    validate(*weights);
+
+    std::lock_guard<std::mutex> lock(_swap_mutex);
+    const uint64_t version = std::atomic_load(&_snapshot)->version + 1;
+    std::atomic_store(&_snapshot, std::shared_ptr<const Snapshot>(std::make_shared<const Snapshot>(Snapshot{ weights, version })));
+    return version;
+}
+
+// throw when m is not n_rows x n_cols or holds values outside [lo, hi], NaN included
+inline void checkOutput( const char* name, const Matrixf& m, int n_rows, int n_cols, float lo, float hi ) {
+    if ( m.rows() != n_rows || m.cols() != n_cols )
+        throw std::runtime_error(std::string("model validation: unexpected shape of ") + name);
+    if ( !( m.minCoeff() >= lo && m.maxCoeff() <= hi ) )
+        throw std::runtime_error(std::string("model validation: ") + name + " out of range");
+}
+
+void ModelHandle::validate( const amtWeights& weights ) {
+    // a 440 Hz tone, silence is not a usable probe as the CQT normalization divides by its zero range
+    Vectorf probe(AUDIO_N_SAMPLES);
+    for ( int i = 0 ; i < AUDIO_N_SAMPLES ; i++ )
+        probe[i] = 0.5f * std::sin(2.0f * static_cast<float>(M_PI) * 440.0f * i / SAMPLE_RATE);
+
+    Matrixf Yp, Yn, Yo;
+    weights.inferenceWindow(probe, Yp, Yn, Yo, false);
+    checkOutput("Yp", Yp, ANNOT_N_FRAMES, N_BINS_CONTOUR, 0.0f, 1.0f);
+    checkOutput("Yn", Yn, ANNOT_N_FRAMES, N_BINS_NOTE, 0.0f, 1.0f);
+    checkOutput("Yo", Yo, ANNOT_N_FRAMES, N_BINS_NOTE, 0.0f, 1.0f);
+}
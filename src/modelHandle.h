@@ -0,0 +1,68 @@
+#pragma once
+
+#include "amtWeights.h"
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+
+// versioned, hot-swappable model weights, read-copy-update style:
+// readers take a snapshot with get() and keep using it even when a newer version is swapped in,
+// the old weights are released once the last request holding them finished
+// the model files are mapped, so roll out a new model into a new directory (or rename new files over
+// the old ones) instead of overwriting the files of a version in use
+class ModelHandle {
+    public:
+
+        // version 1 holds weights
+        ModelHandle( std::shared_ptr<const amtWeights> weights );
+
+        // version 1 holds the weights of config, shared with the process (see amtWeights::shared)
+        ModelHandle( const ModelConfig& config = ModelConfig() );
+
+        // waits for the reloads started by reloadAsync
+        ~ModelHandle();
+
+        ModelHandle( const ModelHandle& ) = delete;
+        ModelHandle& operator=( const ModelHandle& ) = delete;
+
+        // weights of the current version. never waits for a reload: the snapshot is read with
+        // std::atomic_load, which libstdc++ guards with a short internal lock, not with _swap_mutex
+        std::shared_ptr<const amtWeights> get() const;
+
+        uint64_t version() const;
+
+        // load the weights of config fully (lazy is ignored), validate them and swap them in,
+        // returns the new version; throws and keeps the current version when loading or validation fails
+        uint64_t reload( ModelConfig config );
+
+        // reload on a background thread, the handle must not be destroyed before the reload finished,
+        // its destructor blocks until then
+        std::future<uint64_t> reloadAsync( const ModelConfig& config );
+
+        // validate already loaded weights and swap them in, returns the new version
+        uint64_t swap( std::shared_ptr<const amtWeights> weights );
+
+        // run one window of a test tone through the weights and check the shapes and ranges of the outputs,
+        // throws std::runtime_error when they are off
+        static void validate( const amtWeights& weights );
+
+    private:
+
+        struct Snapshot {
+            std::shared_ptr<const amtWeights> weights;
+            uint64_t version;
+        };
+
+        // replaced as a whole, never modified
+        std::shared_ptr<const Snapshot> _snapshot;
+
+        // serializes writers, readers never take it
+        std::mutex _swap_mutex;
+
+        // reloads started by reloadAsync and not finished yet
+        int _n_reloading = 0;
+        std::mutex _reload_mutex;
+        std::condition_variable _reload_cv;
+};
@@ -12,7 +12,7 @@ int computeNFeaturesOut(int n_features_in, int kernel_size_feature, int stride)
 }
 
 // NOTE: use VALID padding as default
-Vectorf conv1d( Vectorf &x, Vectorf &filter_kernel, int stride ) {
+Vectorf conv1d( const Vectorf &x, const Vectorf &filter_kernel, int stride ) {
     std::vector<float> result;
     for ( int i = 0 ; i + filter_kernel.size() <= x.size() ; i += stride ) {
         Vectorf temp = x.segment(i, filter_kernel.size());
@@ -25,13 +25,25 @@ Vectorf conv1d( Vectorf &x, Vectorf &filter_kernel, int stride ) {
 // x.shape = (n_samples, n_features_in)
 // NOTE: Since we are dealing with audio signals, the number of samples remains the same
 Matrixf conv2d( const Matrixf &x, const Matrixf &filter_kernel, int stride ) {
-    int n_samples_out = x.rows();
+    return conv2dRows(x, filter_kernel, stride, 0, x.rows());
+}
+
+// only the input rows needed by [row_begin, row_end) are padded, so time tiles
+// of one output can be computed independently
+Matrixf conv2dRows( const Matrixf &x, const Matrixf &filter_kernel, int stride, int row_begin, int row_end ) {
+    int n_samples_out = row_end - row_begin;
     int n_features_out = computeNFeaturesOut(x.cols(), filter_kernel.cols(), stride);
-    int pad_height = padLength(x.rows(), filter_kernel.rows(), 1, n_samples_out);
+    int pad_height = padLength(x.rows(), filter_kernel.rows(), 1, x.rows());
     int pad_width = padLength(x.cols(), filter_kernel.cols(), stride, n_features_out);
     Matrixf result(n_samples_out, n_features_out);
-    Matrixf padded_x = Matrixf::Zero(x.rows() + pad_height, x.cols() + pad_width);
-    padded_x.block(pad_height / 2, pad_width / 2, x.rows(), x.cols()) = x;
+    Matrixf padded_x = Matrixf::Zero(n_samples_out + pad_height, x.cols() + pad_width);
+
+    // padded_x row k holds x row ( row_begin + k - pad_height / 2 )
+    int x_begin = std::max(0, row_begin - pad_height / 2);
+    int x_end = std::min(static_cast<int>(x.rows()), row_end + pad_height - pad_height / 2);
+    if ( x_end > x_begin )
+        padded_x.block(x_begin - row_begin + pad_height / 2, pad_width / 2, x_end - x_begin, x.cols()) =
+            x.middleRows(x_begin, x_end - x_begin);
     
     // Matrixf temp(filter_kernel.rows(), filter_kernel.cols());
     for ( int i = 0 ; i < n_samples_out ; i++ ) {
@@ -51,7 +63,17 @@ Matrixf conv2d( const Matrixf &x, const Matrixf &filter_kernel, int stride ) {
     return result;
 }
 
-Vectorf reflectionPadding(const Vectorf &x, int pad_length) {
+static thread_local int intra_op_threads = 1;
+
+void setIntraOpThreads( int n_threads ) {
+    intra_op_threads = std::max(1, n_threads);
+}
+
+int getIntraOpThreads() {
+    return intra_op_threads;
+}
+
+Vectorf reflectionPadding(const VectorfRef &x, int pad_length) {
     Vectorf padded_x = Vectorf::Zero(x.size() + 2 * pad_length);
     padded_x.segment(pad_length, x.size()) = x;
     for ( int i = 0 ; i < pad_length ; i++ ) {
@@ -4,11 +4,37 @@
 
 int computeNFeaturesOut(int n_features_in, int kernel_size_feature, int stride);
 
-Vectorf conv1d(Vectorf &x, Vectorf &filter_kernel, int stride);
+Vectorf conv1d(const Vectorf &x, const Vectorf &filter_kernel, int stride);
 
 Matrixf conv2d( const Matrixf &x, const Matrixf &filter_kernel, int stride );
 
-Vectorf reflectionPadding(const Vectorf &x, int pad_length);
+// rows [row_begin, row_end) of conv2d(x, filter_kernel, stride)
+Matrixf conv2dRows( const Matrixf &x, const Matrixf &filter_kernel, int stride, int row_begin, int row_end );
+
+// number of threads a single layer (or CQT) may use, 1 by default
+// thread local, so that concurrent windows pick their own value
+void setIntraOpThreads( int n_threads );
+
+int getIntraOpThreads();
+
+// sets the intra-op threads of the calling thread until the end of the scope, e.g. to decode
+// on a thread outside the pool with the threads of the pool
+class ScopedIntraOpThreads {
+    public:
+
+        ScopedIntraOpThreads( int n_threads ) : _saved(getIntraOpThreads()) { setIntraOpThreads(n_threads); }
+
+        ~ScopedIntraOpThreads() { setIntraOpThreads(_saved); }
+
+        ScopedIntraOpThreads( const ScopedIntraOpThreads& ) = delete;
+        ScopedIntraOpThreads& operator=( const ScopedIntraOpThreads& ) = delete;
+
+    private:
+
+        int _saved;
+};
+
+Vectorf reflectionPadding(const VectorfRef &x, int pad_length);
 
 // shape of input: (H, W)
 Matrixf im2col( const VecMatrixf& input, int n_frames_out, int n_features_out, int kernel_height, int kernel_width, int stride);
@@ -1,21 +1,102 @@
 #include "note.h"
 #include "constant.h"
+#include "nnUtils.h"
 #include <iostream>
 #include <vector>
 #include <tuple>
+#include <algorithm>
+#include <limits>
+#include <fstream>
+#include <stdexcept>
+
+// log(p / (1 - p)) with p clamped to [eps, 1 - eps], finite also for p = 0 and p = 1
+inline float logit( float p ) {
+    constexpr float eps = std::numeric_limits<float>::epsilon();
+    p = std::clamp( p, eps, 1.0f - eps );
+    return std::log( p / ( 1.0f - p ) );
+}
 
 inline float modelFrames2Time( int frame ) {
     return (frame * FFT_HOP) / static_cast<double>(SAMPLE_RATE) - WINDOW_OFFSET * std::floor( frame / ANNOT_N_FRAMES );
 }
 
-std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const Matrixf& Yo, const bool melodia_trick ) {
+void NoteArray::reserve( size_t n_notes ) {
+    start_time.reserve(n_notes);
+    end_time.reserve(n_notes);
+    start_frame.reserve(n_notes);
+    end_frame.reserve(n_notes);
+    pitch.reserve(n_notes);
+    amplitude.reserve(n_notes);
+    bend_offsets.reserve(n_notes + 1);
+}
 
-    int n_frames = Yn.rows(), n_pitches = Yn.cols();
+void NoteArray::push_back( int start, int end, int midi_pitch, float amp ) {
+    start_time.push_back( modelFrames2Time(start) );
+    end_time.push_back( modelFrames2Time(end) );
+    start_frame.push_back(start);
+    end_frame.push_back(end);
+    pitch.push_back(midi_pitch);
+    amplitude.push_back(amp);
+    bend_offsets.push_back( bend_offsets.back() );
+}
 
+void NoteArray::append( const NoteArray& other, size_t idx, int frame_offset ) {
+    push_back( other.start_frame[idx] + frame_offset, other.end_frame[idx] + frame_offset,
+        other.pitch[idx], other.amplitude[idx] );
+    bends.insert( bends.end(), other.bends.begin() + other.bend_offsets[idx], other.bends.begin() + other.bend_offsets[idx + 1] );
+    bend_offsets.back() = bends.size();
+}
+
+Note NoteArray::at( size_t idx ) const {
+    if ( idx >= size() )
+        throw std::out_of_range("note index " + std::to_string(idx) + " out of range for " + std::to_string(size()) + " notes");
+    return Note{
+        start_time[idx],
+        end_time[idx],
+        start_frame[idx],
+        end_frame[idx],
+        pitch[idx],
+        amplitude[idx],
+        std::vector<int>( bends.begin() + bend_offsets[idx], bends.begin() + bend_offsets[idx + 1] )
+    };
+}
+
+std::vector<Note> NoteArray::toNotes() const {
     std::vector<Note> notes;
+    notes.reserve(size());
+    for ( size_t i = 0 ; i < size() ; i++ )
+        notes.emplace_back( at(i) );
+    return notes;
+}
+
+NoteArray NoteArray::fromNotes( const std::vector<Note>& notes ) {
+    NoteArray array;
+    array.reserve(notes.size());
+    for ( const Note& note : notes ) {
+        array.push_back( note.start_frame, note.end_frame, note.pitch, note.amplitude );
+        array.bends.insert( array.bends.end(), note.bends.begin(), note.bends.end() );
+        array.bend_offsets.back() = array.bends.size();
+    }
+    return array;
+}
+
+std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const Matrixf& Yo, const bool melodia_trick, const bool include_pitch_bends, const bool onset_logits,
+    const float onset_threshold, const float frame_threshold, const int min_note_length ) {
+    return modelOutput2NoteArray( Yp, Yn, Yo, melodia_trick, include_pitch_bends, onset_logits,
+        onset_threshold, frame_threshold, min_note_length ).toNotes();
+}
+
+NoteArray modelOutput2NoteArray( const Matrixf& Yp, const Matrixf& Yn, const Matrixf& Yo, const bool melodia_trick, const bool include_pitch_bends, const bool onset_logits,
+    const float onset_threshold, const float frame_threshold, const int min_note_length ) {
+
+    int n_frames = Yn.rows(), n_pitches = Yn.cols();
+
+    NoteArray notes;
     
     // constrainFreq( Yo, Yn, MIN_FREQ, MAX_FREQ );
-    Matrixf infered_Yo = getInferedOnsets( Yo, Yn );
+    Matrixf infered_Yo = onset_logits ? getInferedOnsetLogits( Yo, Yn ) : getInferedOnsets( Yo, Yn );
+    // compare against the threshold in the same domain as infered_Yo
+    const float onset_cutoff = onset_logits ? logit( onset_threshold ) : onset_threshold;
     Matrixf remaining_energy(Yn);
     std::vector<std::tuple<float*, int, int>> remaining_energy_idices;
     if (melodia_trick) remaining_energy_idices.reserve(n_frames * n_pitches);
@@ -38,13 +119,13 @@ std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const
                 continue;
 
             // skip if onset is below threshold
-            if ( onset < ONSET_THRESHOLD )
+            if ( onset < onset_cutoff )
                 continue;
 
             // find time index at this frequency band where the frames drop below an energy threshold
             int i  = start_idx + 1, k = 0;
             while( i < n_frames - 1 && k < ENERGY_THRESHOLD ) {
-                if ( remaining_energy(i, note_idx) < FRAME_THRESHOLD )
+                if ( remaining_energy(i, note_idx) < frame_threshold )
                     k++;
                 else
                     k = 0;
@@ -53,7 +134,7 @@ std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const
             i -= k; // go back to frame above threshold
 
             // if the note is too short, skip it
-            if ( i - start_idx <= MIN_NOTE_LENGTH )
+            if ( i - start_idx <= min_note_length )
                 continue;
 
             remaining_energy.block(start_idx, note_idx, i - start_idx, 1) *= 0;
@@ -64,15 +145,7 @@ std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const
 
             // add the note
             float amplitude = Yn.block(start_idx, note_idx, i - start_idx, 1).mean();
-            notes.emplace_back( Note{
-                modelFrames2Time(start_idx),
-                modelFrames2Time(i),
-                start_idx,
-                i,
-                note_idx + MIDI_OFFSET,
-                amplitude,
-                std::vector<int>()
-            } );
+            notes.push_back( start_idx, i, note_idx + MIDI_OFFSET, amplitude );
         }
     }
 
@@ -93,7 +166,7 @@ std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const
                 continue;
 
             // break if the energy is below threshold
-            if ( *max_energy_ptr <= FRAME_THRESHOLD )
+            if ( *max_energy_ptr <= frame_threshold )
                 break;
 
             remaining_energy(i_mid, freq_idx) = 0;
@@ -101,7 +174,7 @@ std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const
             // forward pass
             int i, k;
             for ( i = i_mid + 1, k = 0 ; i < n_frames - 1 && k < ENERGY_THRESHOLD ; ++i ) {
-                if ( remaining_energy(i, freq_idx) < FRAME_THRESHOLD )
+                if ( remaining_energy(i, freq_idx) < frame_threshold )
                     k++;
                 else
                     k = 0;
@@ -116,7 +189,7 @@ std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const
 
             // backward pass
             for ( i = i_mid - 1, k = 0 ; i > 0 && k < ENERGY_THRESHOLD ; --i ) {
-                if ( remaining_energy(i, freq_idx) < FRAME_THRESHOLD )
+                if ( remaining_energy(i, freq_idx) < frame_threshold )
                     k++;
                 else
                     k = 0;
@@ -129,38 +202,248 @@ std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const
             }
             int i_start = i + 1 + k; // go back to frame above threshold
 
-            if ( i_end - i_start <= MIN_NOTE_LENGTH )
+            if ( i_end - i_start <= min_note_length )
                 continue; // skip if the note is too short
 
             float amplitude = Yn.block(i_start, freq_idx, i_end - i_start, 1).mean();
 
-            notes.emplace_back( Note{
-                modelFrames2Time(i_start),
-                modelFrames2Time(i_end),
-                i_start,
-                i_end,
-                freq_idx + MIDI_OFFSET,
-                amplitude,
-                std::vector<int>()
-            } );
+            notes.push_back( i_start, i_end, freq_idx + MIDI_OFFSET, amplitude );
         }
                 
     }
 
+    if (include_pitch_bends)
+        getPitchBends( Yp, notes );
+
     return notes;
 }
 
+inline Vectorf pitchBendGaussian( const int n_bins_tolerance ) {
+    const int window_length = n_bins_tolerance * 2 + 1;
+    Vectorf freq_gaussian(window_length);
+    for ( int i = 0 ; i < window_length ; i++ ) {
+        float x = ( i - n_bins_tolerance ) / PITCH_BEND_GAUSSIAN_STD;
+        freq_gaussian[i] = std::exp( -0.5f * x * x );
+    }
+    return freq_gaussian;
+}
+
+// same as get_pitch_bends in basic_pitch/note_creation.py
+// for every frame of a note, pick the peak of the gaussian weighted contour bins
+// within n_bins_tolerance around the note center, bends are in units of 1/3 semitone
+// bends must hold end_frame - start_frame entries
+inline void computeNoteBends( const Matrixf& Yp, const Vectorf& freq_gaussian, const int n_bins_tolerance,
+    int start_frame, int end_frame, int pitch, int* bends ) {
+
+    const int n_bins = Yp.cols();
+    int freq_idx = ( pitch - MIDI_OFFSET ) * CONTOURS_BINS_PER_SEMITONE;
+    int freq_start_idx = std::max( freq_idx - n_bins_tolerance, 0 );
+    int freq_end_idx = std::min( n_bins, freq_idx + n_bins_tolerance + 1 );
+    int n_freqs = freq_end_idx - freq_start_idx;
+    int gaussian_start_idx = std::max( 0, n_bins_tolerance - freq_idx );
+    int pb_shift = n_bins_tolerance - gaussian_start_idx;
+
+    const auto gaussian = freq_gaussian.segment( gaussian_start_idx, n_freqs );
+    for ( int t = start_frame ; t < end_frame ; t++ ) {
+        Eigen::Index peak_idx;
+        Yp.row(t).segment( freq_start_idx, n_freqs ).cwiseProduct( gaussian ).maxCoeff( &peak_idx );
+        bends[t - start_frame] = static_cast<int>(peak_idx) - pb_shift;
+    }
+}
+
+void getPitchBends( const Matrixf& Yp, std::vector<Note>& notes, const int n_bins_tolerance ) {
+
+    const Vectorf freq_gaussian = pitchBendGaussian( n_bins_tolerance );
+
+    const int n_threads = getIntraOpThreads();
+#pragma omp parallel for num_threads(n_threads) if(n_threads > 1) schedule(dynamic)
+    for ( int n = 0 ; n < static_cast<int>(notes.size()) ; n++ ) {
+        Note& note = notes[n];
+        note.bends.resize( note.end_frame - note.start_frame );
+        computeNoteBends( Yp, freq_gaussian, n_bins_tolerance,
+            note.start_frame, note.end_frame, note.pitch, note.bends.data() );
+    }
+}
+
+// bends of all notes go to one flattened buffer, offsets are known up front
+void getPitchBends( const Matrixf& Yp, NoteArray& notes, const int n_bins_tolerance ) {
+
+    const Vectorf freq_gaussian = pitchBendGaussian( n_bins_tolerance );
+    const int n_notes = notes.size();
+
+    notes.bend_offsets.resize( n_notes + 1 );
+    notes.bend_offsets[0] = 0;
+    for ( int n = 0 ; n < n_notes ; n++ )
+        notes.bend_offsets[n + 1] = notes.bend_offsets[n] + notes.end_frame[n] - notes.start_frame[n];
+    notes.bends.resize( notes.bend_offsets[n_notes] );
+
+    const int n_threads = getIntraOpThreads();
+#pragma omp parallel for num_threads(n_threads) if(n_threads > 1) schedule(dynamic)
+    for ( int n = 0 ; n < n_notes ; n++ ) {
+        computeNoteBends( Yp, freq_gaussian, n_bins_tolerance,
+            notes.start_frame[n], notes.end_frame[n], notes.pitch[n], notes.bends.data() + notes.bend_offsets[n] );
+    }
+}
+
+// binary layout, little endian, one column after another:
+//   char[4] "BPNA" | uint32 version | uint64 n_notes | uint64 n_bends
+//   float32 start_time[n_notes] | float32 end_time[n_notes]
+//   int32 start_frame[n_notes]  | int32 end_frame[n_notes]
+//   int32 pitch[n_notes]        | float32 amplitude[n_notes]
+//   int32 bend_offsets[n_notes + 1] | int32 bends[n_bends]
+static constexpr char NOTE_ARRAY_MAGIC[4] = {'B', 'P', 'N', 'A'};
+static constexpr uint32_t NOTE_ARRAY_VERSION = 1;
+
+template <typename T>
+inline void writeColumn( std::ofstream& f, const std::vector<T>& column ) {
+    f.write( reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T) );
+}
+
+template <typename T>
+inline void readColumn( std::ifstream& f, std::vector<T>& column, size_t n ) {
+    column.resize(n);
+    f.read( reinterpret_cast<char*>(column.data()), n * sizeof(T) );
+}
+
+void writeNoteArray( const NoteArray& notes, const std::string& path ) {
+    std::ofstream f( path, std::ios::binary );
+    if ( !f )
+        throw std::runtime_error( "Cannot open " + path + " for writing" );
+
+    uint64_t n_notes = notes.size(), n_bends = notes.bends.size();
+    f.write( NOTE_ARRAY_MAGIC, sizeof(NOTE_ARRAY_MAGIC) );
+    f.write( reinterpret_cast<const char*>(&NOTE_ARRAY_VERSION), sizeof(NOTE_ARRAY_VERSION) );
+    f.write( reinterpret_cast<const char*>(&n_notes), sizeof(n_notes) );
+    f.write( reinterpret_cast<const char*>(&n_bends), sizeof(n_bends) );
+
+    writeColumn( f, notes.start_time );
+    writeColumn( f, notes.end_time );
+    writeColumn( f, notes.start_frame );
+    writeColumn( f, notes.end_frame );
+    writeColumn( f, notes.pitch );
+    writeColumn( f, notes.amplitude );
+    writeColumn( f, notes.bend_offsets );
+    writeColumn( f, notes.bends );
+}
+
+NoteArray readNoteArray( const std::string& path ) {
+    std::ifstream f( path, std::ios::binary | std::ios::ate );
+    if ( !f )
+        throw std::runtime_error( "Cannot open " + path + " for reading" );
+    const uint64_t file_size = static_cast<uint64_t>( f.tellg() );
+    f.seekg( 0 );
+
+    char magic[4];
+    uint32_t version;
+    uint64_t n_notes, n_bends;
+    f.read( magic, sizeof(magic) );
+    f.read( reinterpret_cast<char*>(&version), sizeof(version) );
+    f.read( reinterpret_cast<char*>(&n_notes), sizeof(n_notes) );
+    f.read( reinterpret_cast<char*>(&n_bends), sizeof(n_bends) );
+    if ( !f || !std::equal( magic, magic + 4, NOTE_ARRAY_MAGIC ) || version != NOTE_ARRAY_VERSION )
+        throw std::runtime_error( path + " is not a note array file" );
+
+    // checked before allocating the columns, the counts of a damaged header can be huge
+    const uint64_t header_size = sizeof(magic) + sizeof(version) + sizeof(n_notes) + sizeof(n_bends);
+    const uint64_t max_count = file_size / sizeof(int32_t);
+    if ( n_notes > max_count || n_bends > max_count
+        || file_size != header_size + ( 7 * n_notes + 1 + n_bends ) * sizeof(int32_t) )
+        throw std::runtime_error( path + " has an unexpected size" );
+
+    NoteArray notes;
+    readColumn( f, notes.start_time, n_notes );
+    readColumn( f, notes.end_time, n_notes );
+    readColumn( f, notes.start_frame, n_notes );
+    readColumn( f, notes.end_frame, n_notes );
+    readColumn( f, notes.pitch, n_notes );
+    readColumn( f, notes.amplitude, n_notes );
+    readColumn( f, notes.bend_offsets, n_notes + 1 );
+    readColumn( f, notes.bends, n_bends );
+    if ( !f )
+        throw std::runtime_error( path + " is truncated" );
+
+    // note i owns bends[bend_offsets[i], bend_offsets[i+1]), the offsets index the bends unchecked later
+    if ( notes.bend_offsets.front() != 0 || static_cast<uint64_t>( notes.bend_offsets.back() ) != n_bends
+        || !std::is_sorted( notes.bend_offsets.begin(), notes.bend_offsets.end() ) )
+        throw std::runtime_error( path + " has invalid bend offsets" );
+
+    return notes;
+}
+
+// pass 1 of the infered onsets, reduces max(Yo) and max(diff) in one sweep over the rows
+inline void inferedOnsetsMaxima( const Matrixf& Yo, const Matrixf& Yn, float& max_onset, float& max_diff ) {
+    const int n_frames = Yn.rows();
+    float onset_max = -std::numeric_limits<float>::infinity();
+    float diff_max = 0.0f;
+    const int n_threads = getIntraOpThreads();
+#pragma omp parallel for num_threads(n_threads) if(n_threads > 1) reduction(max:onset_max, diff_max)
+    for ( int t = 0 ; t < n_frames ; t++ ) {
+        onset_max = std::max( onset_max, Yo.row(t).maxCoeff() );
+        if ( t < 2 )
+            continue;
+        float row_max = ( Yn.row(t) - Yn.row(t-1) ).cwiseMin( Yn.row(t) - Yn.row(t-2) ).maxCoeff();
+        diff_max = std::max( diff_max, row_max );
+    }
+    max_onset = onset_max;
+    max_diff = diff_max;
+}
+
+// fused version of basic_pitch's get_infered_onsets:
+// diff(t) = max(0, min(Yn(t) - Yn(t-1), Yn(t) - Yn(t-2))), zero for the first 2 frames
+// infered_Yo = max(Yo, diff * max(Yo) / max(diff))
+// pass 1 reduces max(Yo) and max(diff), pass 2 writes the result, both row by row
+// with Eigen expressions so no intermediate matrix is materialized
 Matrixf getInferedOnsets( const Matrixf& Yo, const Matrixf& Yn ) {
 
-    Matrixf shifted_Yn = Matrixf::Zero( Yn.rows(), Yn.cols() );
-    shifted_Yn.block( 2, 0, Yn.rows() - 2, Yn.cols() ) = Yn.block( 0, 0, Yn.rows() - 2, Yn.cols() );
-    Matrixf diff2 = Yn - shifted_Yn;
-    shifted_Yn.block( 1, 0, Yn.rows() - 1, Yn.cols() ) = Yn.block( 0, 0, Yn.rows() - 1, Yn.cols() );
-    Matrixf diff = Yn - shifted_Yn;
-    diff = diff.cwiseMin( diff2 ).cwiseMax(0);
-    diff.block( 0, 0, 2, diff.cols() ) *= 0;
-    return  Yo.cwiseMax( diff * Yo.maxCoeff() / diff.maxCoeff() );
+    const int n_frames = Yn.rows();
+
+    float max_onset, max_diff;
+    inferedOnsetsMaxima( Yo, Yn, max_onset, max_diff );
+
+    // no positive onset difference at all, nothing to infer
+    if ( max_diff <= 0.0f )
+        return Yo;
+
+    const float scale = max_onset / max_diff;
+    Matrixf infered_Yo( Yo.rows(), Yo.cols() );
+    infered_Yo.topRows( std::min( 2, n_frames ) ) = Yo.topRows( std::min( 2, n_frames ) );
+    const int n_threads = getIntraOpThreads();
+#pragma omp parallel for num_threads(n_threads) if(n_threads > 1)
+    for ( int t = 2 ; t < n_frames ; t++ ) {
+        infered_Yo.row(t) = Yo.row(t).cwiseMax(
+            ( Yn.row(t) - Yn.row(t-1) ).cwiseMin( Yn.row(t) - Yn.row(t-2) ).cwiseMax(0.0f) * scale
+        );
+    }
+    return infered_Yo;
+}
+
+// same as getInferedOnsets, but Yo holds the logits of the onset output (no final sigmoid)
+// and so does the result. sigmoid is monotonic, so max(Yo) = sigmoid(max(logits)), and
+// max(sigmoid(z), v) = sigmoid(max(z, logit(v))). logit(v) is only evaluated for the few
+// cells with a positive diff, every other cell keeps its logit
+Matrixf getInferedOnsetLogits( const Matrixf& Yo_logits, const Matrixf& Yn ) {
+
+    const int n_frames = Yn.rows(), n_pitches = Yn.cols();
+
+    float max_logit, max_diff;
+    inferedOnsetsMaxima( Yo_logits, Yn, max_logit, max_diff );
 
+    if ( max_diff <= 0.0f )
+        return Yo_logits;
+
+    const float scale = ( 1.0f / ( 1.0f + std::exp(-max_logit) ) ) / max_diff;
+    Matrixf infered_Yo = Yo_logits;
+    const int n_threads = getIntraOpThreads();
+#pragma omp parallel for num_threads(n_threads) if(n_threads > 1)
+    for ( int t = 2 ; t < n_frames ; t++ ) {
+        for ( int p = 0 ; p < n_pitches ; p++ ) {
+            float diff = std::min( Yn(t, p) - Yn(t-1, p), Yn(t, p) - Yn(t-2, p) );
+            if ( diff <= 0.0f )
+                continue;
+            infered_Yo(t, p) = std::max( infered_Yo(t, p), logit( diff * scale ) );
+        }
+    }
+    return infered_Yo;
 }
 
 inline float hz2midi( float hz ) {
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "typedef.h"
+#include "constant.h"
 #include <vector>
+#include <string>
+#include <cstdint>
 
 struct Note {
     // time in seconds
@@ -15,8 +18,55 @@ struct Note {
     std::vector<int> bends; // units of 1/3 semitone
 };
 
-std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const Matrixf& Yo, const bool melodia_trick = true );
+// structure-of-arrays note storage, note i owns bends[bend_offsets[i], bend_offsets[i+1])
+struct NoteArray {
+    std::vector<float> start_time;
+    std::vector<float> end_time;
+    std::vector<int> start_frame;
+    std::vector<int> end_frame;
+    std::vector<int> pitch;
+    std::vector<float> amplitude;
+    std::vector<int> bends; // flattened, units of 1/3 semitone
+    std::vector<int> bend_offsets = {0}; // size() + 1 entries
+
+    size_t size() const { return pitch.size(); }
+
+    void reserve( size_t n_notes );
+
+    void push_back( int start_frame, int end_frame, int pitch, float amplitude );
+
+    // append note idx of other, its frames shifted by frame_offset
+    void append( const NoteArray& other, size_t idx, int frame_offset );
+
+    // throws std::out_of_range for idx >= size()
+    Note at( size_t idx ) const;
+
+    std::vector<Note> toNotes() const;
+
+    static NoteArray fromNotes( const std::vector<Note>& notes );
+};
+
+// onset_logits: Yo holds the onset logits, i.e. the onset output CNN ran without its final sigmoid
+// onset_threshold is a probability also for onset logits, min_note_length is in frames
+// the parallel loops of the decoder use the intra-op threads of the calling thread (see setIntraOpThreads),
+// amtModel sets them to the pool size around its decoding
+NoteArray modelOutput2NoteArray( const Matrixf& Yp, const Matrixf& Yn, const Matrixf& Yo, const bool melodia_trick = true, const bool include_pitch_bends = true, const bool onset_logits = false,
+    const float onset_threshold = ONSET_THRESHOLD, const float frame_threshold = FRAME_THRESHOLD, const int min_note_length = MIN_NOTE_LENGTH );
+
+std::vector<Note> modelOutput2Notes( const Matrixf& Yp, const Matrixf& Yn, const Matrixf& Yo, const bool melodia_trick = true, const bool include_pitch_bends = true, const bool onset_logits = false,
+    const float onset_threshold = ONSET_THRESHOLD, const float frame_threshold = FRAME_THRESHOLD, const int min_note_length = MIN_NOTE_LENGTH );
+
+void getPitchBends( const Matrixf& Yp, std::vector<Note>& notes, const int n_bins_tolerance = PITCH_BEND_BINS_TOLERANCE );
+
+void getPitchBends( const Matrixf& Yp, NoteArray& notes, const int n_bins_tolerance = PITCH_BEND_BINS_TOLERANCE );
+
+// columnar binary export, see note.cpp for the layout
+void writeNoteArray( const NoteArray& notes, const std::string& path );
+
+NoteArray readNoteArray( const std::string& path );
 
 Matrixf getInferedOnsets( const Matrixf& Yo, const Matrixf& Yn );
 
+Matrixf getInferedOnsetLogits( const Matrixf& Yo_logits, const Matrixf& Yn );
+
 void constrainFreq( Matrixf &Yo, Matrixf &Yn, const float min_freq, const float max_freq );
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "realtimeTranscriber.h"
+#include "constant.h"
+#include "utils.h"
+#include <algorithm>
+#include <limits>
+
+// last CQT frame of a span of AUDIO_N_SAMPLES samples that is kept, plus one
+inline constexpr int CQT_LAST_FRAME = ANNOT_N_FRAMES - N_OVERLAP_FRAMES / 2;
+
+// append the rows of every channel of src to dst
+inline void appendTensorRows( VecMatrixf& dst, const VecMatrixf& src ) {
+    dst.resize(src.size());
+    for ( size_t c = 0 ; c < src.size() ; c++ )
+        appendRows(dst[c], src[c]);
+}
+
+RealtimeTranscriber::RealtimeTranscriber( std::shared_ptr<const amtWeights> weights, int cqt_block_frames ):
+    _weights(weights),
+    // every CQT frame passed on keeps the left context of N_OVERLAP_FRAMES / 2 frames
+    _cqt_block_frames(std::min(std::max(1, cqt_block_frames), WINDOW_OUTPUT_FRAMES)) {
+    reset();
+}
+
+void RealtimeTranscriber::reset() {
+    _audio = Vectorf::Zero((CQT_LAST_FRAME - _cqt_block_frames) * FFT_HOP);
+    _cqt_frame = 0;
+    _n_samples = 0;
+    _n_frames_out = 0;
+    _contour_state.clear();
+    _note_state.clear();
+    _onset_input_state.clear();
+    _onset_output_state.clear();
+    _note_pending.clear();
+    _onset_pending.clear();
+    _Yp_pending.resize(0, N_BINS_CONTOUR);
+    _Yn_pending.resize(0, N_BINS_NOTE);
+    _Yo_pending.resize(0, N_BINS_NOTE);
+}
+
+int RealtimeTranscriber::latencySamples() const {
+    const int cqt_latency = AUDIO_N_SAMPLES - (CQT_LAST_FRAME - 1) * FFT_HOP;
+    const int cnn_latency = std::max(
+        _weights->contourCNN().lookAhead() + _weights->noteCNN().lookAhead(),
+        _weights->onsetInputCNN().lookAhead()
+    ) + _weights->onsetOutputCNN().lookAhead();
+    return cqt_latency + cnn_latency * FFT_HOP;
+}
+
+PosteriorgramBlock RealtimeTranscriber::push( const VectorfRef& samples ) {
+    PosteriorgramBlock block;
+    block.start_frame = _n_frames_out;
+
+    const int n_audio = _audio.size();
+    _audio.conservativeResize(n_audio + samples.size());
+    _audio.tail(samples.size()) = samples;
+    _n_samples += samples.size();
+
+    while ( _audio.size() >= AUDIO_N_SAMPLES )
+        processCQTBlock(block, std::numeric_limits<int>::max());
+
+    return block;
+}
+
+PosteriorgramBlock RealtimeTranscriber::flush() {
+    PosteriorgramBlock block;
+    block.start_frame = _n_frames_out;
+
+    // zeros after the end of the stream, frames past its last frame are not passed on
+    const int n_frames = getNumFrames(_n_samples);
+    while ( _cqt_frame < n_frames ) {
+        if ( _audio.size() < AUDIO_N_SAMPLES ) {
+            const int n_audio = _audio.size();
+            _audio.conservativeResize(AUDIO_N_SAMPLES);
+            _audio.tail(AUDIO_N_SAMPLES - n_audio).setZero();
+        }
+        processCQTBlock(block, n_frames);
+    }
+
+    // the bottom half of the 'same' padding of every Conv2D
+    processFrames(VecMatrixf(N_HARMONICS, Matrixf(0, N_BINS_CONTOUR)), block, true);
+    return block;
+}
+
+void RealtimeTranscriber::processCQTBlock( PosteriorgramBlock& block, int n_frames_max ) {
+    // frames [_cqt_frame, _cqt_frame + _cqt_block_frames) are frames
+    // [CQT_LAST_FRAME - _cqt_block_frames, CQT_LAST_FRAME) of the span
+    VecMatrixf cqt = _weights->cqt().cqtHarmonic(_audio.head(AUDIO_N_SAMPLES), true);
+    const int n_frames = std::max(0, std::min(_cqt_block_frames, n_frames_max - _cqt_frame));
+    for ( Matrixf& harmonic : cqt )
+        harmonic = harmonic.middleRows(CQT_LAST_FRAME - _cqt_block_frames, n_frames).eval();
+    processFrames(cqt, block, false);
+
+    _cqt_frame += _cqt_block_frames;
+    _audio = _audio.tail(_audio.size() - _cqt_block_frames * FFT_HOP).eval();
+}
+
+void RealtimeTranscriber::processFrames( const VecMatrixf& cqt, PosteriorgramBlock& block, bool flush ) {
+    VecMatrixf contour_out, note_out, onset_out, concat_out;
+    _weights->contourCNN().forwardStream(cqt, contour_out, _contour_state, flush);
+    _weights->noteCNN().forwardStream(contour_out, note_out, _note_state, flush);
+    _weights->onsetInputCNN().forwardStream(cqt, onset_out, _onset_input_state, flush);
+    appendRows(_Yp_pending, contour_out[0]);
+    appendRows(_Yn_pending, note_out[0]);
+
+    // the onset output CNN needs the note and the onset input frames side by side,
+    // the note branch has the larger look-ahead and lags behind
+    appendTensorRows(_note_pending, note_out);
+    appendTensorRows(_onset_pending, onset_out);
+    const int n_concat = std::min(_note_pending[0].rows(), _onset_pending[0].rows());
+    VecMatrixf concat_buf;
+    concat_buf.reserve(_note_pending.size() + _onset_pending.size());
+    for ( VecMatrixf* pending : { &_note_pending, &_onset_pending } ) {
+        for ( Matrixf& m : *pending ) {
+            concat_buf.push_back(m.topRows(n_concat));
+            dropRows(m, n_concat);
+        }
+    }
+    _weights->onsetOutputCNN().forwardStream(concat_buf, concat_out, _onset_output_state, flush);
+    appendRows(_Yo_pending, concat_out[0]);
+
+    // hand out the frames finished in all three outputs
+    const int n_ready = std::min({ _Yp_pending.rows(), _Yn_pending.rows(), _Yo_pending.rows() });
+    if ( n_ready == 0 )
+        return;
+    appendRows(block.Yp, _Yp_pending.topRows(n_ready));
+    appendRows(block.Yn, _Yn_pending.topRows(n_ready));
+    appendRows(block.Yo, _Yo_pending.topRows(n_ready));
+    dropRows(_Yp_pending, n_ready);
+    dropRows(_Yn_pending, n_ready);
+    dropRows(_Yo_pending, n_ready);
+    _n_frames_out += n_ready;
+}
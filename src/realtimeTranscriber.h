@@ -0,0 +1,75 @@
+#pragma once
+
+#include "typedef.h"
+#include "amtWeights.h"
+#include <memory>
+#include <vector>
+
+// frames [start_frame, start_frame + Yp.rows()) of the posteriorgrams, Yo as probabilities
+struct PosteriorgramBlock {
+    int start_frame = 0;
+    Matrixf Yp;
+    Matrixf Yn;
+    Matrixf Yo;
+};
+
+// real-time block processing: push audio in blocks of any size (e.g. FFT_HOP samples) and get the
+// posteriorgram frames that became final. the CQT runs every cqt_block_frames frames over the last
+// AUDIO_N_SAMPLES samples, normalized over that span, and keeps its frames N_OVERLAP_FRAMES / 2 away
+// from the end of the span like the windows of transcribeAudio. the CNNs run incrementally, every
+// Conv2D keeps its last kernel_size_time - 1 input frames, so each frame goes through them once.
+// the CQT does not: its log power is min-max normalized over the whole span, so every block computes
+// all ANNOT_N_FRAMES frames of the span to keep cqt_block_frames of them, about 21x the CQT work of
+// transcribeAudio per frame with the default of 8. larger blocks cost less and add latency.
+// frame t is returned once sample t * FFT_HOP + latencySamples() was pushed, rounded up to the next
+// CQT block. frames lie on the exact FFT_HOP grid, while the concatenated windows of transcribeAudio
+// gain WINDOW_OFFSET per window, otherwise they match up to the CQT normalization span
+class RealtimeTranscriber {
+    public:
+
+        RealtimeTranscriber( std::shared_ptr<const amtWeights> weights, int cqt_block_frames = 8 );
+
+        // frames finished by these samples, empty when none
+        PosteriorgramBlock push( const VectorfRef& samples );
+
+        // end of the stream, the remaining frames up to the number of frames of the pushed audio
+        PosteriorgramBlock flush();
+
+        // look-ahead of the CQT and of the CNNs, in samples
+        int latencySamples() const;
+
+        // start a new stream
+        void reset();
+
+    private:
+
+        // run the CQT over _audio and the CNNs over its new frames
+        void processCQTBlock( PosteriorgramBlock& block, int n_frames_max );
+
+        // run the CNNs over new harmonic CQT frames and move the finished frames to block
+        void processFrames( const VecMatrixf& cqt, PosteriorgramBlock& block, bool flush );
+
+        std::shared_ptr<const amtWeights> _weights;
+        int _cqt_block_frames;
+
+        // samples from frame _cqt_frame - (ANNOT_N_FRAMES - N_OVERLAP_FRAMES / 2) on, negative positions are zeros
+        Vectorf _audio;
+        // next CQT frame to pass to the CNNs
+        int _cqt_frame;
+        int _n_samples;
+        // frames already returned
+        int _n_frames_out;
+
+        // per-layer state of the CNNs
+        std::vector<VecMatrixf> _contour_state;
+        std::vector<VecMatrixf> _note_state;
+        std::vector<VecMatrixf> _onset_input_state;
+        std::vector<VecMatrixf> _onset_output_state;
+
+        // frames of each branch that wait for the other branch
+        VecMatrixf _note_pending;
+        VecMatrixf _onset_pending;
+        Matrixf _Yp_pending;
+        Matrixf _Yn_pending;
+        Matrixf _Yo_pending;
+};
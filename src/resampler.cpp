@@ -0,0 +1,112 @@
+#include "resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+// modified Bessel function of the first kind of order 0
+inline double besselI0( double x ) {
+    double sum = 1.0, term = 1.0;
+    for ( int k = 1 ; k < 64 && term > 1e-12 * sum ; k++ ) {
+        term *= ( x / ( 2.0 * k ) ) * ( x / ( 2.0 * k ) );
+        sum += term;
+    }
+    return sum;
+}
+
+// Kaiser window beta, about 80 dB of stopband attenuation
+inline constexpr double RESAMPLER_KAISER_BETA = 8.6;
+
+Resampler::Resampler( int rate_in, int rate_out, int zero_crossings, float rolloff ):
+    _rate_in(rate_in),
+    _rate_out(rate_out) {
+
+    if ( rate_in <= 0 || rate_out <= 0 )
+        throw std::invalid_argument("Resampler: sample rates must be positive");
+    const int g = std::gcd(rate_in, rate_out);
+    _L = rate_out / g;
+    _M = rate_in / g;
+
+    // cutoff relative to the Nyquist frequency of the input, the sinc widens by 1 / cutoff when downsampling,
+    // at equal rates the full band keeps the signal as it is
+    const double cutoff = _L == _M ? 1.0 : rolloff * std::min(1.0, static_cast<double>(_L) / _M);
+    _half_taps = static_cast<int>(std::ceil(zero_crossings / cutoff));
+    const double i0_beta = besselI0(RESAMPLER_KAISER_BETA);
+
+    _table.resize(_L, 2 * _half_taps);
+    for ( int p = 0 ; p < _L ; p++ ) {
+        double sum = 0.0;
+        for ( int j = 0 ; j < 2 * _half_taps ; j++ ) {
+            // distance of the input from the output position in input samples
+            const double x = j - _half_taps + 1 - static_cast<double>(p) / _L;
+            const double u = x / _half_taps;
+            const double t = M_PI * cutoff * x;
+            const double sinc = t == 0.0 ? 1.0 : std::sin(t) / t;
+            const double window = std::abs(u) < 1.0 ? besselI0(RESAMPLER_KAISER_BETA * std::sqrt(1.0 - u * u)) / i0_beta : 0.0;
+            _table(p, j) = static_cast<float>(sinc * window);
+            sum += _table(p, j);
+        }
+        // unit gain at DC for every phase
+        _table.row(p) /= static_cast<float>(sum);
+    }
+    reset();
+}
+
+void Resampler::reset() {
+    _buffer.assign(_half_taps - 1, 0.0f);
+    _buffer_start = -( _half_taps - 1 );
+    _n_in = 0;
+    _n_out = 0;
+    _base = 0;
+    _phase = 0;
+    _n_out_total = -1;
+}
+
+void Resampler::push( const float* src, int n_samples ) {
+    _buffer.insert(_buffer.end(), src, src + n_samples);
+    _n_in += n_samples;
+}
+
+void Resampler::finish() {
+    if ( _n_out_total >= 0 )
+        return;
+    _n_out_total = ( _n_in * _L + _M - 1 ) / _M;
+    // zeros after the end of the stream as the right context of the last outputs
+    _buffer.insert(_buffer.end(), _half_taps, 0.0f);
+}
+
+int Resampler::pull( float* dst, int n_samples ) {
+    const int64_t buffer_end = _buffer_start + static_cast<int64_t>(_buffer.size());
+    int n = 0;
+    while ( n < n_samples && _base + _half_taps < buffer_end && ( _n_out_total < 0 || _n_out < _n_out_total ) ) {
+        const Eigen::Map<const Vectorf> x(_buffer.data() + ( _base - _half_taps + 1 - _buffer_start ), 2 * _half_taps);
+        dst[n++] = _table.row(_phase).dot(x);
+        _n_out++;
+        _phase += _M;
+        _base += _phase / _L;
+        _phase %= _L;
+    }
+
+    // drop the inputs no output needs anymore, in bulk to keep the erase cheap
+    const int64_t n_drop = _base - _half_taps + 1 - _buffer_start;
+    if ( n_drop > 0 && n_drop >= static_cast<int64_t>(_buffer.size()) / 2 ) {
+        _buffer.erase(_buffer.begin(), _buffer.begin() + n_drop);
+        _buffer_start += n_drop;
+    }
+    return n;
+}
+
+Vectorf resample( const VectorfRef& audio, int rate_in, int rate_out ) {
+    if ( rate_in == rate_out )
+        return audio;
+    Resampler resampler(rate_in, rate_out);
+    resampler.push(audio.data(), audio.size());
+    resampler.finish();
+    Vectorf output(( static_cast<int64_t>(audio.size()) * rate_out + rate_in - 1 ) / rate_in);
+    output.conservativeResize(resampler.pull(output.data(), output.size()));
+    return output;
+}
+
+Vectorf downmix( const Matrixf& frames ) {
+    return frames.rowwise().mean().transpose();
+}
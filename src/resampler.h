@@ -0,0 +1,59 @@
+#pragma once
+
+#include "typedef.h"
+#include "constant.h"
+#include <cstdint>
+#include <vector>
+
+// streaming polyphase resampler for rational ratios rate_out / rate_in = L / M
+// output n lies at input position n * M / L, it is the dot product of the 2 * half_taps input samples around
+// it with the row of the filter table of its phase ( n * M ) % L, a Kaiser windowed sinc precomputed per phase
+// the cutoff lies at rolloff * the lower Nyquist frequency, so downsampling does not alias
+class Resampler {
+    public:
+
+        Resampler( int rate_in, int rate_out = SAMPLE_RATE, int zero_crossings = 24, float rolloff = 0.95f );
+
+        // append samples of the stream
+        void push( const float* src, int n_samples );
+
+        // end of the stream, the remaining outputs up to ceil( n_in * L / M ) become available
+        void finish();
+
+        // copy up to n_samples final outputs into dst, returns the number copied
+        int pull( float* dst, int n_samples );
+
+        // start a new stream
+        void reset();
+
+        int rateIn() const { return _rate_in; }
+        int rateOut() const { return _rate_out; }
+
+    private:
+
+        int _rate_in;
+        int _rate_out;
+        // reduced ratio
+        int _L;
+        int _M;
+        int _half_taps;
+        // L x 2 * half_taps, row p holds the taps of the inputs base - half_taps + 1 ... base + half_taps
+        Matrixf _table;
+
+        // inputs from absolute index _buffer_start on, negative indices are the zeros before the stream
+        std::vector<float> _buffer;
+        int64_t _buffer_start;
+        int64_t _n_in;
+        // next output, its base input and phase
+        int64_t _n_out;
+        int64_t _base;
+        int _phase;
+        // number of outputs of the whole stream once it is finished, -1 before
+        int64_t _n_out_total;
+};
+
+// the whole signal at rate_out
+Vectorf resample( const VectorfRef& audio, int rate_in, int rate_out = SAMPLE_RATE );
+
+// the average of the channels of frames x channels samples
+Vectorf downmix( const Matrixf& frames );
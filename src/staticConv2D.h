@@ -0,0 +1,88 @@
+#pragma once
+
+#include "layer.h"
+#include "nnUtils.h"
+#include <algorithm>
+
+// Conv2D with the shape known at compile time, used for the weights compiled into the binary (see embeddedModel.h)
+// the kernel sizes, the stride and the channel counts are constants, so the inner products over a kernel are
+// fixed size Eigen expressions that the compiler fully unrolls and vectorizes
+template <int N_IN, int N_OUT, int KT, int KF, int STRIDE>
+class StaticConv2D : public Conv2D {
+    public:
+
+        typedef Eigen::Matrix<float, KT, KF, Eigen::RowMajor> Kernel;
+
+        // output filters per block of the kernel layout
+        static constexpr int BLOCK = N_OUT % KERNEL_BLOCK == 0 ? KERNEL_BLOCK : 1;
+
+        // kernel and bias are static data, laid out like the kernel of Conv2D
+        StaticConv2D( int n_features_in, const float* kernel, const float* bias ) :
+            Conv2D(N_IN, N_OUT, n_features_in, KT, KF, STRIDE, std::shared_ptr<const float>(std::shared_ptr<const float>(), kernel), bias) {}
+
+    protected:
+
+        void convolvePadded( const VecMatrixf& padded, VecMatrixf& output, int n_frames_out ) const override {
+            output.resize(N_OUT);
+            for ( int j = 0 ; j < N_OUT ; j++ ) {
+                output[j].resize(n_frames_out, _n_features_out);
+            }
+
+            // same work split as Conv2D::convolvePadded
+            constexpr int N_BLOCKS = N_OUT / BLOCK;
+            const int n_threads = getIntraOpThreads();
+            const int n_tiles = n_threads > N_BLOCKS ? (n_threads + N_BLOCKS - 1) / N_BLOCKS : 1;
+            const int tile_length = (n_frames_out + n_tiles - 1) / n_tiles;
+            const int n_features_out = _n_features_out;
+
+#pragma omp parallel for num_threads(n_threads) if(n_threads > 1) schedule(dynamic)
+            for ( int w = 0 ; w < N_BLOCKS * n_tiles ; w++ ) {
+                int j = w / n_tiles * BLOCK;
+                int row_begin = (w % n_tiles) * tile_length;
+                int row_end = std::min(n_frames_out, row_begin + tile_length);
+                if ( row_begin >= row_end )
+                    continue;
+                if constexpr ( BLOCK > 1 ) {
+                    convolveBlock(padded, output, j, row_begin, row_end);
+                    continue;
+                }
+                Matrixf& out = output[j];
+                out.middleRows(row_begin, row_end - row_begin).setZero();
+                for ( int i = 0 ; i < N_IN ; i++ ) {
+                    // a block of one output filter is the plain layout
+                    const Eigen::Map<const Kernel> kernel( _kernel.get() + ( j * N_IN + i ) * KT * KF );
+                    const Matrixf& in = padded[i];
+                    for ( int t = row_begin ; t < row_end ; t++ ) {
+                        for ( int f = 0 ; f < n_features_out ; f++ ) {
+                            out(t, f) += in.template block<KT, KF>(t, f * STRIDE).cwiseProduct(kernel).sum();
+                        }
+                    }
+                }
+                out.middleRows(row_begin, row_end - row_begin).array() += _bias[j];
+            }
+        }
+
+    private:
+
+        // Conv2D::convolveBlock with all loop bounds known at compile time
+        void convolveBlock( const VecMatrixf& padded, VecMatrixf& output, int j_begin, int row_begin, int row_end ) const {
+            const float* block_kernel = _kernel.get() + j_begin * N_IN * KT * KF;
+            for ( int t = row_begin ; t < row_end ; t++ ) {
+                for ( int f = 0 ; f < _n_features_out ; f++ ) {
+                    float acc[BLOCK] = {};
+                    const float* w = block_kernel;
+                    for ( int i = 0 ; i < N_IN ; i++ ) {
+                        for ( int kt = 0 ; kt < KT ; kt++ ) {
+                            const float* x = &padded[i](t + kt, f * STRIDE);
+                            for ( int kf = 0 ; kf < KF ; kf++, w += BLOCK ) {
+                                for ( int o = 0 ; o < BLOCK ; o++ )
+                                    acc[o] += x[kf] * w[o];
+                            }
+                        }
+                    }
+                    for ( int o = 0 ; o < BLOCK ; o++ )
+                        output[j_begin + o](t, f) = acc[o] + _bias[j_begin + o];
+                }
+            }
+        }
+};
@@ -0,0 +1,115 @@
+#include "taskGraph.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+
+int TaskGraph::addNode( const std::string& name, std::function<void()> task, const std::vector<int>& deps ) {
+    int id = _nodes.size();
+    for ( int dep : deps ) {
+        if ( dep < 0 || dep >= id )
+            throw std::invalid_argument( "TaskGraph: node " + name + " depends on an unknown node" );
+        _nodes[dep].successors.push_back(id);
+    }
+    _nodes.push_back( Node{ name, std::move(task), {}, static_cast<int>(deps.size()) } );
+    return id;
+}
+
+struct TaskGraph::RunState {
+    std::unique_ptr<std::atomic<int>[]> pending;
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable cv;
+    // nodes whose dependencies finished, taken by pool tasks and by the thread in run
+    std::deque<int> ready;
+    int n_done = 0;
+};
+
+void TaskGraph::schedule( std::shared_ptr<RunState> state, ThreadPool& pool, int id ) {
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->ready.push_back(id);
+    }
+    state->cv.notify_all();
+    // runs one ready node, which may already have been taken by run, then the queue is empty
+    pool.submit( [this, state, &pool] {
+        int next;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if ( state->ready.empty() )
+                return;
+            next = state->ready.front();
+            state->ready.pop_front();
+        }
+        execute(state, pool, next);
+    } );
+}
+
+void TaskGraph::execute( std::shared_ptr<RunState> state, ThreadPool& pool, int id ) {
+    if ( !state->failed ) {
+        try {
+            _nodes[id].task();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if ( !state->failed.exchange(true) )
+                state->error = std::current_exception();
+        }
+    }
+    for ( int next : _nodes[id].successors ) {
+        if ( --state->pending[next] == 0 )
+            schedule(state, pool, next);
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if ( ++state->n_done == static_cast<int>(_nodes.size()) )
+        state->cv.notify_all();
+}
+
+void TaskGraph::run( ThreadPool& pool ) {
+    const int n_nodes = _nodes.size();
+    if ( n_nodes == 0 )
+        return;
+
+    auto state = std::make_shared<RunState>();
+    state->pending.reset( new std::atomic<int>[n_nodes] );
+    for ( int i = 0 ; i < n_nodes ; i++ )
+        state->pending[i] = _nodes[i].n_deps;
+
+    for ( int i = 0 ; i < n_nodes ; i++ ) {
+        if ( _nodes[i].n_deps == 0 )
+            schedule(state, pool, i);
+    }
+
+    // the caller runs ready nodes too, so the graph completes even when every worker of the
+    // pool is blocked, e.g. when run is called from a task of the same pool
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while ( state->n_done < n_nodes ) {
+        if ( state->ready.empty() ) {
+            state->cv.wait(lock);
+            continue;
+        }
+        const int id = state->ready.front();
+        state->ready.pop_front();
+        lock.unlock();
+        execute(state, pool, id);
+        lock.lock();
+    }
+    if ( state->error )
+        std::rethrow_exception( state->error );
+}
+
+std::string TaskGraph::get_name() const {
+    std::string name = "TaskGraph <\n";
+    for ( size_t i = 0 ; i < _nodes.size() ; i++ ) {
+        name += "\t" + std::to_string(i) + " " + _nodes[i].name + " ->";
+        for ( int next : _nodes[i].successors )
+            name += " " + std::to_string(next);
+        name += "\n";
+    }
+    name += ">";
+    return name;
+}
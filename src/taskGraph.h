@@ -0,0 +1,43 @@
+#pragma once
+
+#include "threadPool.h"
+#include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+
+// a DAG of tasks, every node is submitted to the pool as soon as all of its dependencies finished
+class TaskGraph {
+    public:
+
+        // returns the id of the new node, dependencies must be added before their dependents
+        int addNode( const std::string& name, std::function<void()> task, const std::vector<int>& deps = {} );
+
+        // run all nodes on the pool and block until they are done, the calling thread runs ready
+        // nodes while it waits, so run may be called from a task of the same pool
+        // the first exception thrown by a node is rethrown here, its dependents are skipped
+        void run( ThreadPool& pool );
+
+        size_t size() const { return _nodes.size(); }
+
+        std::string get_name() const;
+
+    private:
+
+        // per-run state, kept alive by the tasks in flight
+        struct RunState;
+
+        // queue a node whose dependencies finished and submit a task to run it
+        void schedule( std::shared_ptr<RunState> state, ThreadPool& pool, int id );
+
+        void execute( std::shared_ptr<RunState> state, ThreadPool& pool, int id );
+
+        struct Node {
+            std::string name;
+            std::function<void()> task;
+            std::vector<int> successors;
+            int n_deps;
+        };
+
+        std::vector<Node> _nodes;
+};
@@ -0,0 +1,74 @@
+#include "threadPool.h"
+#include <cstdlib>
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+int getNumThreads() {
+    const char* env = std::getenv("OMP_NUM_THREADS");
+    if ( env && std::atoi(env) > 0 )
+        return std::atoi(env);
+    return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+ThreadPool::ThreadPool( int n_threads ) {
+    n_threads = std::max( 1, n_threads );
+    _workers.reserve(n_threads);
+    for ( int i = 0 ; i < n_threads ; i++ )
+        _workers.emplace_back( &ThreadPool::workerLoop, this );
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::shared() {
+    static std::mutex mutex;
+    static std::weak_ptr<ThreadPool> entry;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<ThreadPool> pool = entry.lock();
+    if ( !pool ) {
+        pool = std::make_shared<ThreadPool>();
+        entry = pool;
+    }
+    return pool;
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    for ( auto& worker : _workers )
+        worker.join();
+}
+
+void ThreadPool::submit( std::function<void()> task ) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.emplace_back( std::move(task) );
+    }
+    _cv.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+    while ( true ) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait( lock, [this] { return _stop || !_tasks.empty(); } );
+            if ( _stop && _tasks.empty() )
+                return;
+            task = std::move( _tasks.front() );
+            _tasks.pop_front();
+        }
+        // tasks handle their own errors, an escaping one is logged instead of terminating the process
+        try {
+            task();
+        }
+        catch ( const std::exception& e ) {
+            std::cerr << "thread pool task failed: " << e.what() << std::endl;
+        }
+        catch (...) {
+            std::cerr << "thread pool task failed" << std::endl;
+        }
+    }
+}
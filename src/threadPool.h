@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+// number of worker threads, OMP_NUM_THREADS if set, otherwise the number of cores
+int getNumThreads();
+
+// fixed size pool of worker threads consuming a FIFO task queue
+class ThreadPool {
+    public:
+
+        ThreadPool( int n_threads = getNumThreads() );
+
+        ~ThreadPool();
+
+        ThreadPool( const ThreadPool& ) = delete;
+        ThreadPool& operator=( const ThreadPool& ) = delete;
+
+        // pool of getNumThreads() workers shared by the whole process, created when no session holds it
+        static std::shared_ptr<ThreadPool> shared();
+
+        void submit( std::function<void()> task );
+
+        int size() const { return _workers.size(); }
+
+    private:
+
+        void workerLoop();
+
+        std::vector<std::thread> _workers;
+        std::deque<std::function<void()>> _tasks;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        bool _stop = false;
+};
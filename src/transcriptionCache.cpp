@@ -0,0 +1,271 @@
+#include "transcriptionCache.h"
+#include "hash.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <zlib.h>
+
+struct CacheFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t audio_hash;
+    uint64_t n_samples;
+    uint64_t model_fingerprint;
+    uint32_t notes_only;
+    uint32_t n_frames;
+    uint32_t n_notes;
+    uint32_t n_bends;
+    // deflated byte planes of Yp, Yn and Yo
+    uint64_t compressed_size;
+    // hash64 of the header, with a zero checksum, and of all bytes after it
+    uint64_t checksum;
+};
+
+static_assert( sizeof(CacheFileHeader) == 64, "unexpected padding in CacheFileHeader" );
+
+inline uint64_t fileChecksum( CacheFileHeader header, const std::vector<uint8_t>& bytes ) {
+    header.checksum = 0;
+    return hash64(bytes.data() + sizeof(header), bytes.size() - sizeof(header), hash64(&header, sizeof(header)));
+}
+
+std::string CacheKey::name() const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx-%016llx%s.bptc", static_cast<unsigned long long>(audio_hash),
+        static_cast<unsigned long long>(model_fingerprint), notes_only ? "-n" : "");
+    return name;
+}
+
+TranscriptionCache::TranscriptionCache( const std::string& dir, int compression_level, uint64_t max_bytes ):
+    _dir(dir),
+    _compression_level(compression_level),
+    _max_bytes(max_bytes),
+    _hits(0),
+    _misses(0) {
+    std::filesystem::create_directories(dir);
+}
+
+CacheKey TranscriptionCache::key( const VectorfRef& audio, uint64_t model_fingerprint, bool notes_only ) {
+    CacheKey key;
+    key.audio_hash = hash64(audio.data(), audio.size() * sizeof(float), model_fingerprint);
+    key.n_samples = audio.size();
+    key.model_fingerprint = model_fingerprint;
+    key.notes_only = notes_only;
+    return key;
+}
+
+std::string TranscriptionCache::path( const CacheKey& key ) const {
+    return ( std::filesystem::path(_dir) / key.name() ).string();
+}
+
+// byte k of every float goes to plane k
+inline void shuffleBytes( const float* src, size_t n, uint8_t* dst ) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(src);
+    for ( size_t i = 0 ; i < n ; i++ )
+        for ( size_t k = 0 ; k < sizeof(float) ; k++ )
+            dst[k * n + i] = bytes[i * sizeof(float) + k];
+}
+
+inline void unshuffleBytes( const uint8_t* src, size_t n, float* dst ) {
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(dst);
+    for ( size_t i = 0 ; i < n ; i++ )
+        for ( size_t k = 0 ; k < sizeof(float) ; k++ )
+            bytes[i * sizeof(float) + k] = src[k * n + i];
+}
+
+template <typename T>
+inline void appendColumn( std::vector<uint8_t>& bytes, const std::vector<T>& column ) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(column.data());
+    bytes.insert(bytes.end(), data, data + column.size() * sizeof(T));
+}
+
+// reads n values of a column, false when the buffer ends before
+template <typename T>
+inline bool readColumn( const uint8_t*& p, const uint8_t* end, std::vector<T>& column, size_t n ) {
+    if ( static_cast<size_t>(end - p) < n * sizeof(T) )
+        return false;
+    column.resize(n);
+    std::memcpy(column.data(), p, n * sizeof(T));
+    p += n * sizeof(T);
+    return true;
+}
+
+bool TranscriptionCache::store( const CacheKey& key, const Matrixf& Yp, const Matrixf& Yn, const Matrixf& Yo, const NoteArray& notes ) const {
+    const size_t n_frames = Yp.rows();
+    const size_t n_values = Yp.size() + Yn.size() + Yo.size();
+    if ( Yp.cols() != N_BINS_CONTOUR || Yn.cols() != N_BINS_NOTE || Yo.cols() != N_BINS_NOTE
+        || Yn.rows() != Yp.rows() || Yo.rows() != Yp.rows() || Yp.rows() != getNumFrames(static_cast<int>(key.n_samples)) )
+        return false;
+
+    // the frames of the three posteriorgrams one after the other, as byte planes
+    std::vector<float> values(n_values);
+    std::memcpy(values.data(), Yp.data(), Yp.size() * sizeof(float));
+    std::memcpy(values.data() + Yp.size(), Yn.data(), Yn.size() * sizeof(float));
+    std::memcpy(values.data() + Yp.size() + Yn.size(), Yo.data(), Yo.size() * sizeof(float));
+    std::vector<uint8_t> planes(n_values * sizeof(float));
+    shuffleBytes(values.data(), n_values, planes.data());
+
+    std::vector<uint8_t> bytes(sizeof(CacheFileHeader));
+    appendColumn(bytes, notes.start_frame);
+    appendColumn(bytes, notes.end_frame);
+    appendColumn(bytes, notes.pitch);
+    appendColumn(bytes, notes.amplitude);
+    appendColumn(bytes, notes.bend_offsets);
+    appendColumn(bytes, notes.bends);
+
+    const size_t offset = bytes.size();
+    uLongf compressed_size = compressBound(planes.size());
+    bytes.resize(offset + compressed_size);
+    if ( compress2(bytes.data() + offset, &compressed_size, planes.data(), planes.size(), _compression_level) != Z_OK )
+        return false;
+    bytes.resize(offset + compressed_size);
+
+    CacheFileHeader header;
+    std::memcpy(header.magic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC));
+    header.version = CACHE_FILE_VERSION;
+    header.audio_hash = key.audio_hash;
+    header.n_samples = key.n_samples;
+    header.model_fingerprint = key.model_fingerprint;
+    header.notes_only = key.notes_only;
+    header.n_frames = n_frames;
+    header.n_notes = notes.size();
+    header.n_bends = notes.bends.size();
+    header.compressed_size = compressed_size;
+    header.checksum = fileChecksum(header, bytes);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+
+    // readers see either no entry or a complete one
+    const std::string final_path = path(key);
+    const std::string tmp_path = final_path + ".tmp" + std::to_string(std::random_device()());
+    {
+        std::ofstream f(tmp_path, std::ios::binary);
+        f.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if ( !f ) {
+            f.close();
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tmp_path, final_path, error);
+    if ( error ) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    if ( _max_bytes > 0 )
+        evict(final_path);
+    return true;
+}
+
+void TranscriptionCache::evict( const std::string& keep ) const {
+    struct Entry {
+        std::filesystem::file_time_type time;
+        uint64_t size;
+        std::filesystem::path path;
+    };
+
+    // entries removed by another process while listing are skipped
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code error;
+    for ( std::filesystem::directory_iterator it(_dir, error), end ; !error && it != end ; it.increment(error) ) {
+        if ( it->path().extension() != ".bptc" )
+            continue;
+        std::error_code entry_error;
+        Entry entry{ it->last_write_time(entry_error), 0, it->path() };
+        if ( entry_error )
+            continue;
+        entry.size = it->file_size(entry_error);
+        if ( entry_error )
+            continue;
+        total += entry.size;
+        entries.push_back(entry);
+    }
+    if ( total <= _max_bytes )
+        return;
+
+    std::sort(entries.begin(), entries.end(), [] ( const Entry& a, const Entry& b ) { return a.time < b.time; });
+    const std::filesystem::path keep_name = std::filesystem::path(keep).filename();
+    for ( const Entry& entry : entries ) {
+        if ( total <= _max_bytes )
+            break;
+        if ( entry.path.filename() == keep_name )
+            continue;
+        if ( std::filesystem::remove(entry.path, error) )
+            total -= entry.size;
+    }
+}
+
+bool TranscriptionCache::load( const CacheKey& key, Matrixf& Yp, Matrixf& Yn, Matrixf& Yo, NoteArray& notes ) const {
+    const std::string entry_path = path(key);
+    std::ifstream f(entry_path, std::ios::binary | std::ios::ate);
+    if ( !f ) {
+        _misses++;
+        return false;
+    }
+    std::vector<uint8_t> bytes(static_cast<size_t>(f.tellg()));
+    f.seekg(0);
+    f.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+
+    CacheFileHeader header;
+    if ( !f || bytes.size() < sizeof(header) ) {
+        _misses++;
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    // the full key, the file name only holds part of it
+    if ( std::memcmp(header.magic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC)) != 0 || header.version != CACHE_FILE_VERSION
+        || header.audio_hash != key.audio_hash || header.n_samples != key.n_samples
+        || header.model_fingerprint != key.model_fingerprint || header.notes_only != static_cast<uint32_t>(key.notes_only)
+        || header.n_frames != static_cast<uint64_t>(getNumFrames(static_cast<int>(key.n_samples)))
+        || header.checksum != fileChecksum(header, bytes) ) {
+        _misses++;
+        return false;
+    }
+
+    const uint8_t* p = bytes.data() + sizeof(header);
+    const uint8_t* end = bytes.data() + bytes.size();
+    std::vector<int> start_frame, end_frame, pitch, bend_offsets, bends;
+    std::vector<float> amplitude;
+    bool valid = readColumn(p, end, start_frame, header.n_notes) && readColumn(p, end, end_frame, header.n_notes)
+        && readColumn(p, end, pitch, header.n_notes) && readColumn(p, end, amplitude, header.n_notes)
+        && readColumn(p, end, bend_offsets, static_cast<size_t>(header.n_notes) + 1) && readColumn(p, end, bends, header.n_bends)
+        && static_cast<uint64_t>(end - p) == header.compressed_size;
+
+    const size_t n_frames = header.n_frames;
+    const size_t n_values = n_frames * ( N_BINS_CONTOUR + 2 * N_BINS_NOTE );
+    std::vector<uint8_t> planes(n_values * sizeof(float));
+    uLongf planes_size = planes.size();
+    valid = valid && uncompress(planes.data(), &planes_size, p, header.compressed_size) == Z_OK && planes_size == planes.size();
+    if ( !valid ) {
+        _misses++;
+        return false;
+    }
+
+    std::vector<float> values(n_values);
+    unshuffleBytes(planes.data(), n_values, values.data());
+    Yp = Eigen::Map<const Matrixf>(values.data(), n_frames, N_BINS_CONTOUR);
+    Yn = Eigen::Map<const Matrixf>(values.data() + n_frames * N_BINS_CONTOUR, n_frames, N_BINS_NOTE);
+    Yo = Eigen::Map<const Matrixf>(values.data() + n_frames * ( N_BINS_CONTOUR + N_BINS_NOTE ), n_frames, N_BINS_NOTE);
+
+    // the times follow from the frames
+    notes = NoteArray();
+    notes.reserve(header.n_notes);
+    for ( size_t i = 0 ; i < header.n_notes ; i++ )
+        notes.push_back(start_frame[i], end_frame[i], pitch[i], amplitude[i]);
+    notes.bends = std::move(bends);
+    notes.bend_offsets = std::move(bend_offsets);
+
+    // the modification time orders the entries for eviction
+    if ( _max_bytes > 0 ) {
+        std::error_code error;
+        std::filesystem::last_write_time(entry_path, std::filesystem::file_time_type::clock::now(), error);
+    }
+
+    _hits++;
+    return true;
+}
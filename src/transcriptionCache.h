@@ -0,0 +1,65 @@
+#pragma once
+
+#include "typedef.h"
+#include "note.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// identifies a transcription: the samples, the weights (amtWeights::fingerprint) and the decoder mode
+struct CacheKey {
+    uint64_t audio_hash = 0;
+    uint64_t n_samples = 0;
+    uint64_t model_fingerprint = 0;
+    bool notes_only = false;
+
+    // file name of the entry
+    std::string name() const;
+};
+
+inline constexpr char CACHE_FILE_MAGIC[4] = { 'B', 'P', 'T', 'C' };
+inline constexpr uint32_t CACHE_FILE_VERSION = 2;
+
+// on-disk content addressed cache of transcriptions, one file per key in a directory
+// an entry holds the posteriorgrams, so a hit can be decoded again with other thresholds, and the
+// notes decoded with the default thresholds. the posteriorgrams are stored losslessly: the floats are
+// split into byte planes, whose sign and exponent planes compress well, and then deflated.
+// entries are written to a temporary file and renamed, so processes can share one directory.
+// missing, damaged or foreign entries are misses, failing writes are ignored.
+// without max_bytes the directory grows without bound. with it, a store exceeding max_bytes removes the
+// least recently used entries, a hit refreshes the modification time of its entry
+class TranscriptionCache {
+    public:
+
+        // compression_level of zlib, 1 is fastest, max_bytes caps the total size of the entries, 0 for no cap
+        TranscriptionCache( const std::string& dir, int compression_level = 1, uint64_t max_bytes = 0 );
+
+        static CacheKey key( const VectorfRef& audio, uint64_t model_fingerprint, bool notes_only );
+
+        // fill the posteriorgrams and the notes of key, false on a miss
+        bool load( const CacheKey& key, Matrixf& Yp, Matrixf& Yn, Matrixf& Yo, NoteArray& notes ) const;
+
+        // returns false when the entry could not be written
+        bool store( const CacheKey& key, const Matrixf& Yp, const Matrixf& Yn, const Matrixf& Yo, const NoteArray& notes ) const;
+
+        const std::string& dir() const { return _dir; }
+
+        uint64_t maxBytes() const { return _max_bytes; }
+
+        uint64_t hits() const { return _hits; }
+        uint64_t misses() const { return _misses; }
+
+    private:
+
+        std::string path( const CacheKey& key ) const;
+
+        // remove the least recently used entries but keep until the entries fit in _max_bytes
+        void evict( const std::string& keep ) const;
+
+        std::string _dir;
+        int _compression_level;
+        uint64_t _max_bytes;
+
+        mutable std::atomic<uint64_t> _hits;
+        mutable std::atomic<uint64_t> _misses;
+};
@@ -0,0 +1,87 @@
+#include "transcriptionJob.h"
+#include "nnUtils.h"
+#include <iostream>
+
+TranscriptionJob::TranscriptionJob( std::shared_ptr<const amtWeights> weights, const Vectorf& audio, bool notes_only, Callback on_done ):
+    _weights(weights),
+    _audio(audio),
+    _n_windows(_audio.size()),
+    _notes_only(notes_only),
+    _on_done(on_done),
+    _n_done(0),
+    _cancelled(false),
+    _future(_promise.get_future().share()) {
+
+    const int n_frames = getNumFrames(audio.size());
+    _Yp.resize(n_frames, N_BINS_CONTOUR);
+    _Yn.resize(n_frames, N_BINS_NOTE);
+    _Yo.resize(n_frames, N_BINS_NOTE);
+}
+
+void TranscriptionJob::cancel() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if ( !_finished )
+        _cancelled = true;
+}
+
+void TranscriptionJob::runWindow( int idx, int intra_threads ) {
+    if ( !_cancelled ) {
+        try {
+            setIntraOpThreads(intra_threads);
+            Matrixf Yp, Yn, Yo;
+            _weights->inferenceWindow(_audio.window(idx), Yp, Yn, Yo, _notes_only);
+            writeWindowFrames(_Yp, Yp, idx);
+            writeWindowFrames(_Yn, Yn, idx);
+            writeWindowFrames(_Yo, Yo, idx);
+        }
+        catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if ( !_error )
+                    _error = std::current_exception();
+            }
+            // skip the remaining windows
+            _cancelled = true;
+        }
+    }
+    if ( ++_n_done == _n_windows )
+        finish();
+}
+
+void TranscriptionJob::finish() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _finished = true;
+    }
+
+    if ( _error )
+        _promise.set_exception(_error);
+    else if ( _cancelled )
+        _promise.set_exception(std::make_exception_ptr(TranscriptionCancelled()));
+    else {
+        try {
+            _promise.set_value(modelOutput2Notes(_Yp, _Yn, _Yo, true, true, _notes_only));
+        }
+        catch (...) {
+            _promise.set_exception(std::current_exception());
+        }
+    }
+
+    // a throwing callback must not take down the pool thread, and with it the process
+    if ( _on_done ) {
+        try {
+            _on_done(shared_from_this());
+        }
+        catch ( const std::exception& e ) {
+            std::cerr << "transcription callback failed: " << e.what() << std::endl;
+        }
+        catch (...) {
+            std::cerr << "transcription callback failed" << std::endl;
+        }
+    }
+
+    // the posteriorgrams are not needed anymore
+    _Yp.resize(0, 0);
+    _Yn.resize(0, 0);
+    _Yo.resize(0, 0);
+}
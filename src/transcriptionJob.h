@@ -0,0 +1,90 @@
+#pragma once
+
+#include "typedef.h"
+#include "note.h"
+#include "utils.h"
+#include "amtWeights.h"
+#include <atomic>
+#include <future>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <exception>
+
+// stored in the future of a cancelled job
+struct TranscriptionCancelled : std::runtime_error {
+    TranscriptionCancelled() : std::runtime_error("transcription cancelled") {}
+};
+
+// handle of a transcription running on a thread pool, see amtModel::transcribeAsync
+// every window is one pool task, the task finishing the last window decodes the notes,
+// fulfills the future, calls the completion callback on the same pool thread and then frees the posteriorgrams.
+// an exception thrown by the callback is logged and dropped
+class TranscriptionJob : public std::enable_shared_from_this<TranscriptionJob> {
+    public:
+
+        typedef std::function<void(std::shared_ptr<TranscriptionJob>)> Callback;
+
+        TranscriptionJob( std::shared_ptr<const amtWeights> weights, const Vectorf& audio, bool notes_only, Callback on_done );
+
+        TranscriptionJob( const TranscriptionJob& ) = delete;
+        TranscriptionJob& operator=( const TranscriptionJob& ) = delete;
+
+        int numWindows() const { return _n_windows; }
+
+        // windows finished or skipped so far
+        int windowsDone() const { return _n_done; }
+
+        float progress() const { return _n_windows > 0 ? _n_done / static_cast<float>(_n_windows) : 1.0f; }
+
+        // windows that did not start yet are skipped, the future then holds TranscriptionCancelled
+        // no-op once the last window finished, the job then keeps its result
+        void cancel();
+
+        bool cancelled() const { return _cancelled; }
+
+        bool done() const { return _future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
+        std::shared_future<std::vector<Note>> future() const { return _future; }
+
+        // block until the job finished, rethrows its error
+        std::vector<Note> get() const { return _future.get(); }
+
+        // run window idx, called by the pool tasks
+        void runWindow( int idx, int intra_threads );
+
+        std::shared_ptr<const amtWeights> weights() const { return _weights; }
+
+        bool notesOnly() const { return _notes_only; }
+
+        // posteriorgrams of the job, valid only until the completion callback returns
+        const Matrixf& Yp() const { return _Yp; }
+        const Matrixf& Yn() const { return _Yn; }
+        const Matrixf& Yo() const { return _Yo; }
+
+    private:
+
+        void finish();
+
+        std::shared_ptr<const amtWeights> _weights;
+        WindowedAudio _audio;
+        int _n_windows;
+        bool _notes_only;
+        Callback _on_done;
+
+        // full length posteriorgrams, windows write disjoint rows
+        Matrixf _Yp;
+        Matrixf _Yn;
+        Matrixf _Yo;
+
+        std::atomic<int> _n_done;
+        std::atomic<bool> _cancelled;
+        // set by finish, guarded by _mutex like _error so cancel() cannot race the outcome
+        bool _finished = false;
+        std::exception_ptr _error;
+        std::mutex _mutex;
+
+        std::promise<std::vector<Note>> _promise;
+        std::shared_future<std::vector<Note>> _future;
+};
@@ -17,5 +17,7 @@ typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
     Matrixf;
 typedef Eigen::Matrix<std::complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
     Matrixcf;
+// read only view of a Vectorf or any contiguous part of one, e.g. an audio window
+typedef Eigen::Ref<const Vectorf> VectorfRef;
 typedef std::vector<Matrixf, Eigen::aligned_allocator<Matrixf>> VecMatrixf;
 typedef std::vector<VecMatrixf, Eigen::aligned_allocator<VecMatrixf>> VecVecMatrixf;
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <cmath>
 #include <csignal>
+#include <stdexcept>
 
 void printMat(Matrixf &mat) {
     std::cout << mat << std::endl;
@@ -70,7 +71,7 @@ void updateEDParams(CQParams &params) {
 // x.shape = (n_samples)
 // filter_kernel.shape = (1, kernel_length), default kernel_length = 256
 // return_x.shape = (n_samples // 2)
-Matrixf downsamplingByN(Vectorf &x, Vectorf &filter_kernel, float n) {
+Matrixf downsamplingByN(const VectorfRef &x, const Vectorf &filter_kernel, float n) {
     int pad_length = (filter_kernel.cols() - 1) / 2;
 
     Vectorf padded_x = Vectorf::Zero(x.size() + 2 * pad_length);
@@ -78,39 +79,70 @@ Matrixf downsamplingByN(Vectorf &x, Vectorf &filter_kernel, float n) {
     return conv1d(padded_x, filter_kernel, static_cast<int>(n));
 }
 
-std::vector<Vectorf> getWindowedAudio( const Vectorf &x ) {
+int getNumWindows( int audio_length ) {
+    int padded_audio_length = audio_length + OVERLAP_LENGTH / 2;
+    return std::ceil(static_cast<float>(padded_audio_length) / static_cast<float>(WINDOW_HOP_SIZE));
+}
 
-    int audio_length = x.size() + OVERLAP_LENGTH / 2;
-    int n_windows = std::ceil(static_cast<float>(audio_length) / static_cast<float>(WINDOW_HOP_SIZE));
-    int padded_length = (n_windows - 1) * WINDOW_HOP_SIZE + AUDIO_N_SAMPLES;
+WindowedAudio::WindowedAudio( const VectorfRef& x ) {
+    _n_windows = getNumWindows(x.size());
+    int padded_length = (_n_windows - 1) * WINDOW_HOP_SIZE + AUDIO_N_SAMPLES;
     // add padding to the audio signal
-    Vectorf padded_x = Vectorf::Zero(padded_length);
-    padded_x.segment(OVERLAP_LENGTH / 2, x.size()) = x;
-    
+    _padded = Vectorf::Zero(padded_length);
+    _padded.segment(OVERLAP_LENGTH / 2, x.size()) = x;
+}
+
+WindowedAudio WindowedAudio::fromPadded( const VectorfRef& padded ) {
+    WindowedAudio windowed;
+    windowed._padded = padded;
+    windowed._n_windows = padded.size() < AUDIO_N_SAMPLES ? 0 :
+        (padded.size() - AUDIO_N_SAMPLES) / WINDOW_HOP_SIZE + 1;
+    return windowed;
+}
+
+Eigen::Map<const Vectorf> WindowedAudio::window( int idx ) const {
+    return Eigen::Map<const Vectorf>(_padded.data() + idx * WINDOW_HOP_SIZE, AUDIO_N_SAMPLES);
+}
+
+std::vector<Vectorf> getWindowedAudio( const Vectorf &x ) {
+
+    WindowedAudio windowed(x);
+
     std::vector<Vectorf> result;
-    for ( int i = 0 ; i + AUDIO_N_SAMPLES <= padded_length ; i += WINDOW_HOP_SIZE ) {
-        Vectorf temp = padded_x.segment(i, AUDIO_N_SAMPLES);
-        result.emplace_back(temp);
+    result.reserve(windowed.size());
+    for ( int i = 0 ; i < windowed.size() ; i++ ) {
+        result.emplace_back(windowed.window(i));
     }
 
     return result;
 }
 
-Matrixf concatMatrices(const VecMatrixf &matrices, int audio_length ) {
-    int n_frames_original = std::floor(audio_length * (ANNOTATIONS_FPS * 1.0f /SAMPLE_RATE) );
-    int mat_height = matrices[0].rows() - N_OVERLAP_FRAMES;
-    int mat_width = matrices[0].cols();
-    Matrixf result = Matrixf::Zero( matrices.size() * mat_height, mat_width );
-    int start = 0;
-    for ( const Matrixf& m : matrices ) {
-        // remove half of the overlap frames from the beginning and the end
-        result.block(start, 0, 
-            mat_height, mat_width
-            ) = 
-            m.block(N_OVERLAP_FRAMES/2, 0, 
-            mat_height, mat_width
-        );
-        start += mat_height;
+void appendRows( Matrixf &dst, const Matrixf &src ) {
+    if ( dst.rows() == 0 ) {
+        dst = src;
+        return;
     }
-    return result.block(0, 0, n_frames_original, mat_width);
+    const int n_rows = dst.rows();
+    dst.conservativeResize(n_rows + src.rows(), Eigen::NoChange);
+    dst.bottomRows(src.rows()) = src;
+}
+
+void dropRows( Matrixf &m, int n_rows ) {
+    if ( n_rows > 0 )
+        m = m.bottomRows(m.rows() - n_rows).eval();
+}
+
+int getNumFrames( int audio_length ) {
+    return std::floor(audio_length * (ANNOTATIONS_FPS * 1.0f / SAMPLE_RATE));
+}
+
+void writeWindowFrames( Matrixf &dst, const Matrixf &window, int idx ) {
+    if ( window.rows() != ANNOT_N_FRAMES || window.cols() != dst.cols() )
+        throw std::runtime_error("writeWindowFrames: unexpected window output shape");
+    int start = idx * WINDOW_OUTPUT_FRAMES;
+    int n_frames = std::min(WINDOW_OUTPUT_FRAMES, static_cast<int>(dst.rows()) - start);
+    if ( n_frames <= 0 )
+        return;
+    // remove half of the overlap frames from the beginning
+    dst.middleRows(start, n_frames) = window.middleRows(N_OVERLAP_FRAMES / 2, n_frames);
 }
\ No newline at end of file
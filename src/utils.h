@@ -2,6 +2,7 @@
 
 #include "typedef.h"
 #include "CQT.h"
+#include "constant.h"
 #include <vector>
 
 void printMat(Matrixf &mat);
@@ -16,8 +17,49 @@ Vectorcf getHann(int window_size);
 
 void updateEDParams(CQParams &params);
 
-Matrixf downsamplingByN(Vectorf &x, Vectorf &filter_kernel, float n);
+Matrixf downsamplingByN(const VectorfRef &x, const Vectorf &filter_kernel, float n);
 
+int getNumWindows(int audio_length);
+
+// all windows of an audio signal as views into a single zero padded copy,
+// window i covers samples [i * WINDOW_HOP_SIZE, i * WINDOW_HOP_SIZE + AUDIO_N_SAMPLES) of it
+class WindowedAudio {
+    public:
+
+        WindowedAudio( const VectorfRef& x );
+
+        int size() const { return _n_windows; }
+
+        // windows over samples that already carry their padding, e.g. a segment of a stream
+        // starting at its first window, trailing samples that do not fill a window are ignored
+        static WindowedAudio fromPadded( const VectorfRef& padded );
+
+        // the idx-th window, valid as long as this object lives
+        Eigen::Map<const Vectorf> window( int idx ) const;
+
+    private:
+
+        WindowedAudio() = default;
+
+        Vectorf _padded;
+        int _n_windows;
+};
+
+// copies of all windows, see WindowedAudio for a copy free version
 std::vector<Vectorf> getWindowedAudio(const Vectorf &x);
 
-Matrixf concatMatrices(const VecMatrixf &matrices, int audio_length);
\ No newline at end of file
+// append the rows of src to dst
+void appendRows(Matrixf &dst, const Matrixf &src);
+
+// remove the first n_rows rows of m
+void dropRows(Matrixf &m, int n_rows);
+
+// number of model output frames of an audio signal
+int getNumFrames(int audio_length);
+
+// frames of the full posteriorgram each window contributes, half of the overlap is trimmed at each side
+inline constexpr int WINDOW_OUTPUT_FRAMES = ANNOT_N_FRAMES - N_OVERLAP_FRAMES;
+
+// write the trimmed frames of the idx-th window output into the full posteriorgram dst,
+// frames past the end of dst are dropped
+void writeWindowFrames(Matrixf &dst, const Matrixf &window, int idx);
\ No newline at end of file
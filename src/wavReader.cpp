@@ -0,0 +1,173 @@
+#include "wavReader.h"
+#include "constant.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// little endian integers at unaligned addresses
+inline uint32_t readU32( const uint8_t* p ) { return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( static_cast<uint32_t>(p[3]) << 24 ); }
+inline uint16_t readU16( const uint8_t* p ) { return p[0] | ( p[1] << 8 ); }
+
+// format tags of the fmt chunk
+inline constexpr uint16_t WAVE_FORMAT_PCM = 0x0001;
+inline constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+inline constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+WavReader::WavReader( const std::string& path ) : _file(std::make_shared<const MappedFile>(path)), _data(nullptr), _pos(0) {
+    const uint8_t* p = _file->data();
+    const size_t size = _file->size();
+    if ( size < 12 || std::memcmp(p, "RIFF", 4) != 0 || std::memcmp(p + 8, "WAVE", 4) != 0 )
+        throw std::runtime_error(path + " is not a WAV file");
+
+    bool has_fmt = false;
+    uint16_t format = 0;
+    int block_align = 0;
+    size_t data_size = 0;
+
+    // chunks are padded to an even size
+    size_t offset = 12;
+    while ( offset + 8 <= size ) {
+        const uint8_t* chunk = p + offset;
+        const size_t chunk_size = std::min<size_t>(readU32(chunk + 4), size - offset - 8);
+        if ( std::memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16 ) {
+            format = readU16(chunk + 8);
+            _info.n_channels = readU16(chunk + 10);
+            _info.sample_rate = readU32(chunk + 12);
+            block_align = readU16(chunk + 20);
+            _info.bits_per_sample = readU16(chunk + 22);
+            // the sub format GUID starts with the format tag
+            if ( format == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 40 )
+                format = readU16(chunk + 32);
+            has_fmt = true;
+        }
+        else if ( std::memcmp(chunk, "data", 4) == 0 ) {
+            // a streamed file may leave the size open, it then reaches the end of the file
+            _data = chunk + 8;
+            data_size = chunk_size;
+            break;
+        }
+        offset += 8 + chunk_size + ( chunk_size & 1 );
+    }
+
+    if ( !has_fmt || !_data )
+        throw std::runtime_error(path + ": missing fmt or data chunk");
+    _info.is_float = format == WAVE_FORMAT_IEEE_FLOAT;
+    const int bits = _info.bits_per_sample;
+    const bool supported = format == WAVE_FORMAT_PCM ? ( bits == 8 || bits == 16 || bits == 24 || bits == 32 )
+        : format == WAVE_FORMAT_IEEE_FLOAT ? ( bits == 32 || bits == 64 ) : false;
+    if ( !supported )
+        throw std::runtime_error(path + ": unsupported WAV format " + std::to_string(format) + " with " + std::to_string(bits) + " bits");
+    if ( _info.n_channels <= 0 || _info.sample_rate <= 0 || block_align != _info.n_channels * bits / 8 )
+        throw std::runtime_error(path + ": invalid WAV format chunk");
+    _info.n_frames = data_size / block_align;
+    if ( _info.n_channels > 1 )
+        _frames.resize(std::max(1, 1024 / _info.n_channels) * _info.n_channels);
+    if ( _info.sample_rate != SAMPLE_RATE )
+        _resampler = std::make_unique<Resampler>(_info.sample_rate, SAMPLE_RATE);
+}
+
+void WavReader::convert( float* dst, int64_t first, int n_values ) const {
+    const int bytes = _info.bits_per_sample / 8;
+    const uint8_t* src = _data + first * bytes;
+    if ( _info.is_float && bytes == 4 ) {
+        std::memcpy(dst, src, n_values * sizeof(float));
+        return;
+    }
+    for ( int i = 0 ; i < n_values ; i++, src += bytes ) {
+        switch ( _info.is_float ? -bytes : bytes ) {
+            case 1:
+                dst[i] = ( src[0] - 128 ) / 128.0f;
+                break;
+            case 2:
+                dst[i] = static_cast<int16_t>(readU16(src)) / 32768.0f;
+                break;
+            case 3:
+                // sign extend from 24 bits
+                dst[i] = ( static_cast<int32_t>( ( src[0] << 8 ) | ( src[1] << 16 ) | ( static_cast<uint32_t>(src[2]) << 24 ) ) >> 8 ) / 8388608.0f;
+                break;
+            case 4:
+                dst[i] = static_cast<int32_t>(readU32(src)) / 2147483648.0f;
+                break;
+            case -8: {
+                double v;
+                std::memcpy(&v, src, sizeof(v));
+                dst[i] = static_cast<float>(v);
+                break;
+            }
+        }
+    }
+}
+
+int WavReader::readFrames( float* dst, int n_frames ) {
+    const int n = static_cast<int>(std::min<int64_t>(n_frames, _info.n_frames - _pos));
+    if ( n <= 0 )
+        return 0;
+    convert(dst, _pos * _info.n_channels, n * _info.n_channels);
+    _pos += n;
+    return n;
+}
+
+int WavReader::readMono( float* dst, int n_frames ) {
+    if ( _info.n_channels == 1 )
+        return readFrames(dst, n_frames);
+
+    // downmix chunk by chunk through a small buffer
+    const int n_channels = _info.n_channels;
+    const int chunk_frames = static_cast<int>(_frames.size()) / n_channels;
+    int n_read = 0;
+    while ( n_read < n_frames ) {
+        const int n = readFrames(_frames.data(), std::min(chunk_frames, n_frames - n_read));
+        if ( n == 0 )
+            break;
+        for ( int i = 0 ; i < n ; i++ ) {
+            float sum = 0.0f;
+            for ( int c = 0 ; c < n_channels ; c++ )
+                sum += _frames[i * n_channels + c];
+            dst[n_read + i] = sum / n_channels;
+        }
+        n_read += n;
+    }
+    return n_read;
+}
+
+int WavReader::read( float* dst, int n_samples ) {
+    if ( !_resampler )
+        return readMono(dst, n_samples);
+
+    float buffer[1024];
+    int n_read = 0;
+    while ( n_read < n_samples ) {
+        const int n = _resampler->pull(dst + n_read, n_samples - n_read);
+        n_read += n;
+        if ( n > 0 )
+            continue;
+        // feed the resampler until it has outputs
+        const int n_in = readMono(buffer, sizeof(buffer) / sizeof(float));
+        if ( n_in > 0 ) {
+            _resampler->push(buffer, n_in);
+            continue;
+        }
+        // end of the file, the last outputs
+        _resampler->finish();
+        n_read += _resampler->pull(dst + n_read, n_samples - n_read);
+        break;
+    }
+    return n_read;
+}
+
+void WavReader::seek( int64_t frame ) {
+    _pos = std::min(std::max<int64_t>(0, frame), _info.n_frames);
+    if ( _resampler )
+        _resampler->reset();
+}
+
+Vectorf loadWav( const std::string& path, int sample_rate ) {
+    WavReader reader(path);
+    const WavInfo& info = reader.info();
+
+    Vectorf audio(info.n_frames);
+    reader.readMono(audio.data(), info.n_frames);
+    if ( sample_rate > 0 && sample_rate != info.sample_rate )
+        return resample(audio, info.sample_rate, sample_rate);
+    return audio;
+}
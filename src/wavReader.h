@@ -0,0 +1,65 @@
+#pragma once
+
+#include "typedef.h"
+#include "audioReader.h"
+#include "mappedFile.h"
+#include "resampler.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// format of the samples of a WAV file
+struct WavInfo {
+    int sample_rate = 0;
+    int n_channels = 0;
+    int64_t n_frames = 0;
+    // per sample and channel: 8, 16, 24 or 32 for PCM, 32 or 64 for float
+    int bits_per_sample = 0;
+    bool is_float = false;
+};
+
+// reads a RIFF/WAVE file (PCM 8/16/24/32 bit, IEEE float 32/64 bit, also in WAVE_FORMAT_EXTENSIBLE),
+// the file is mapped and the samples are converted to float in [-1, 1] only as they are read, read()
+// downmixes and resamples them to the input of the model
+// throws std::runtime_error when the file can not be read or has an unsupported format
+class WavReader : public AudioReader {
+    public:
+
+        WavReader( const std::string& path );
+
+        const WavInfo& info() const { return _info; }
+
+        // up to n_frames interleaved frames ( n_frames * n_channels values ) from the current position,
+        // returns the number of frames read, 0 at the end of the file
+        int readFrames( float* dst, int n_frames );
+
+        // up to n_frames frames as the average of their channels, at the sample rate of the file
+        int readMono( float* dst, int n_frames );
+
+        // AudioReader: the average of the channels, resampled to SAMPLE_RATE
+        int read( float* dst, int n_samples ) override;
+
+        // continue reading at frame, a resampled stream starts anew
+        void seek( int64_t frame );
+
+        int64_t position() const { return _pos; }
+
+    private:
+
+        // convert n_values samples starting at the value index first
+        void convert( float* dst, int64_t first, int n_values ) const;
+
+        std::shared_ptr<const MappedFile> _file;
+        // first byte of the sample data
+        const uint8_t* _data;
+        WavInfo _info;
+        int64_t _pos;
+        // interleaved frames downmixed by readMono, at least one frame whatever the channel count
+        std::vector<float> _frames;
+        // only when the file is not at SAMPLE_RATE
+        std::unique_ptr<Resampler> _resampler;
+};
+
+// the whole file as mono at sample_rate, 0 keeps the sample rate of the file
+Vectorf loadWav( const std::string& path, int sample_rate = SAMPLE_RATE );
@@ -0,0 +1,14 @@
+import pytest
+import wave
+
+def write_wav(path, frames, sample_rate=22050):
+    # frames of shape (n_frames, n_channels) in [-1, 1] as 16 bit PCM
+    with wave.open(str(path), 'wb') as f:
+        f.setnchannels(frames.shape[1])
+        f.setsampwidth(2)
+        f.setframerate(sample_rate)
+        f.writeframes((frames * 32767).round().astype('<i2').tobytes())
+
+@pytest.fixture(name="write_wav")
+def write_wav_fixture():
+    return write_wav
@@ -89,6 +89,318 @@ def test_inference(vis = False):
         plot_hm(plot_dict)
 
 
+def test_notes_only():
+    import BasiCPP_Pitch
+
+    audio = get_audio(shorten=True)
+
+    bp_model = BasiCPP_Pitch.amtModel()
+    gold = bp_model.transcribeAudio(audio)
+    _, _, gold_Yo = bp_model.getOutput()
+
+    bp_model.setNotesOnly(True)
+    notes = bp_model.transcribeAudio(audio)
+    _, _, Yo = bp_model.getOutput()
+
+    assert len(notes) == len(gold)
+    for note, gold_note in zip(notes, gold):
+        assert (note.start_frame, note.end_frame, note.pitch) == (gold_note.start_frame, gold_note.end_frame, gold_note.pitch)
+    assert np.allclose(Yo, gold_Yo, atol=1e-6)
+
+
+def test_pipeline():
+    import BasiCPP_Pitch
+
+    audio = get_audio(shorten=True)
+
+    bp_model = BasiCPP_Pitch.amtModel()
+    gold = bp_model.transcribeAudio(audio)
+    gold_outputs = bp_model.getOutput()
+
+    config = BasiCPP_Pitch.PipelineConfig()
+    config.enabled = True
+    config.queue_capacity = 1
+    bp_model.setPipelineConfig(config)
+    notes = bp_model.transcribeAudio(audio)
+
+    assert len(notes) == len(gold)
+    for output, gold_output in zip(bp_model.getOutput(), gold_outputs):
+        assert np.allclose(output, gold_output)
+
+
+def test_output_copies():
+    import BasiCPP_Pitch
+
+    audio = get_audio(shorten=True)
+
+    bp_model = BasiCPP_Pitch.amtModel()
+    bp_model.transcribeAudio(audio)
+    Yp, Yn, Yo = bp_model.getOutput()
+
+    # one frame every FFT_HOP samples, windows write their frames in place
+    n_frames = int(np.floor(audio.shape[0] * (22050 // 256) / 22050))
+    for copy, output in zip([bp_model.getYp(), bp_model.getYn(), bp_model.getYo()], [Yp, Yn, Yo]):
+        assert copy.shape[0] == n_frames
+        assert np.array_equal(copy, output)
+
+    # the arrays own their data and outlive the buffers resized by the next transcription
+    Yp_copy = bp_model.getYp()
+    bp_model.transcribeAudio(audio[:audio.shape[0] // 2])
+    assert np.array_equal(Yp_copy, Yp)
+
+
+def test_stream():
+    import BasiCPP_Pitch
+
+    audio = get_audio(shorten=True)
+
+    bp_model = BasiCPP_Pitch.amtModel()
+    gold = bp_model.transcribeAudio(audio)
+
+    def reader(signal, chunk_size):
+        pos = 0
+        def read(n):
+            nonlocal pos
+            chunk = signal[pos:pos + min(n, chunk_size)]
+            pos += chunk.shape[0]
+            return chunk
+        return read
+
+    # the whole signal fits into one decoded block
+    config = BasiCPP_Pitch.StreamConfig()
+    config.context_frames = audio.shape[0]
+    notes = bp_model.transcribeStream(reader(audio, 4096), config)
+    assert [(n.start_frame, n.end_frame, n.pitch) for n in notes] == [(n.start_frame, n.end_frame, n.pitch) for n in gold]
+
+    # small blocks only differ at block boundaries
+    config = BasiCPP_Pitch.StreamConfig()
+    config.segment_windows = 4
+    blocks = []
+    bp_model.transcribeStream(reader(audio, 1000), lambda block: blocks.append(len(block)), config)
+    assert abs(sum(blocks) - len(gold)) <= 0.1 * len(gold)
+
+    gold_notes = {(n.start_frame, n.pitch) for n in gold}
+    notes = bp_model.transcribeStream(reader(audio, 1000), config)
+    assert len(gold_notes & {(n.start_frame, n.pitch) for n in notes}) >= 0.9 * len(gold)
+
+
+def test_async():
+    import BasiCPP_Pitch
+    import threading
+
+    audio = get_audio(shorten=True)
+
+    bp_model = BasiCPP_Pitch.amtModel()
+    gold = bp_model.transcribeAudio(audio)
+
+    finished = threading.Event()
+    job = bp_model.transcribeAsync(audio, lambda job: finished.set())
+    notes = job.get()
+    assert finished.wait(10)
+    assert job.done() and job.progress() == 1.0
+    assert [(n.start_frame, n.pitch) for n in notes] == [(n.start_frame, n.pitch) for n in gold]
+
+    # the windows may all have run before cancel() is seen, then the job keeps its notes
+    job = bp_model.transcribeAsync(audio)
+    job.cancel()
+    try:
+        notes = job.get()
+        assert not job.cancelled()
+        assert [(n.start_frame, n.pitch) for n in notes] == [(n.start_frame, n.pitch) for n in gold]
+    except BasiCPP_Pitch.TranscriptionCancelled:
+        assert job.cancelled() and job.done()
+
+    # cancel() of a finished job is a no-op
+    job = bp_model.transcribeAsync(audio)
+    job.get()
+    job.cancel()
+    assert not job.cancelled()
+    assert len(job.get()) == len(gold)
+
+    # a raising callback is reported, the job keeps its notes and the pool keeps working
+    import sys
+    unraisable = []
+    reported = threading.Event()
+    def hook(args):
+        unraisable.append(args.exc_type)
+        reported.set()
+    default_hook = sys.unraisablehook
+    sys.unraisablehook = hook
+    try:
+        def raising(job):
+            raise ValueError("callback failed")
+        job = bp_model.transcribeAsync(audio, raising)
+        assert len(job.get()) == len(gold)
+        assert reported.wait(10)
+        job = bp_model.transcribeAsync(audio)
+        assert len(job.get()) == len(gold)
+    finally:
+        sys.unraisablehook = default_hook
+    assert unraisable == [ValueError]
+
+
+def test_realtime():
+    import BasiCPP_Pitch
+
+    audio = get_audio(shorten=True)[:22050 * 10]
+
+    bp_model = BasiCPP_Pitch.amtModel()
+    bp_model.transcribeAudio(audio)
+    gold_Yp, _, _ = bp_model.getOutput()
+
+    # FFT_HOP, AUDIO_N_SAMPLES and the last kept frame of a span, ANNOT_N_FRAMES - N_OVERLAP_FRAMES / 2
+    hop, span, last_frame, block_frames = 256, 43842, 157, 8
+    cqt_latency = span - (last_frame - 1) * hop
+    latency = BasiCPP_Pitch.RealtimeTranscriber(bp_model.getWeights()).latencySamples()
+    assert latency < 22050 and (latency - cqt_latency) % hop == 0
+    look_ahead = (latency - cqt_latency) // hop
+
+    rt = BasiCPP_Pitch.RealtimeTranscriber(bp_model.getWeights(), block_frames)
+    blocks = []
+    frame = 0
+    for i in range(0, audio.shape[0], hop):
+        b = rt.push(audio[i:i + hop])
+        blocks.append(b)
+        assert b.start_frame == frame
+        frame += b.Yp.shape[0]
+
+        # frame t is out once sample t * hop + latency was pushed, rounded up to the next CQT block
+        n_pushed = min(i + hop, audio.shape[0])
+        first_block = cqt_latency + (block_frames - 1) * hop
+        n_cqt = block_frames * ((n_pushed - first_block) // (block_frames * hop) + 1) if n_pushed >= first_block else 0
+        assert frame == max(0, n_cqt - look_ahead)
+    blocks.append(rt.flush())
+    assert blocks[-1].start_frame == frame
+    frame += blocks[-1].Yp.shape[0]
+    assert frame == gold_Yp.shape[0]
+
+    # the frames of block k are the rows [last_frame - block_frames, last_frame) of the CQT of the span
+    # ending block_frames * (k + 1) frames in, the incremental CNN matches the whole CNN over them
+    padded = np.concatenate([np.zeros((last_frame - block_frames) * hop, dtype=np.float32), audio,
+        np.zeros(span, dtype=np.float32)])
+    cq = BasiCPP_Pitch.CQ()
+    cqt = np.concatenate([
+        cq.harmonicStacking(np.ascontiguousarray(padded[k * block_frames * hop:k * block_frames * hop + span]), True)
+            [:, last_frame - block_frames:last_frame]
+        for k in range((frame + block_frames - 1) // block_frames)
+    ], axis=1)[:, :frame]
+    gold_contour = BasiCPP_Pitch.CNN("Contour").forward(np.ascontiguousarray(cqt))[0]
+
+    Yp = np.concatenate([b.Yp for b in blocks if b.Yp.shape[0] > 0])
+    assert np.allclose(Yp, gold_contour, atol=1e-4)
+    # transcribeAudio normalizes the CQT over other spans and drifts by WINDOW_OFFSET per window
+    assert np.abs(Yp - gold_Yp).mean() < 0.05
+
+
+def test_shared_weights():
+    import BasiCPP_Pitch
+    from concurrent.futures import ThreadPoolExecutor
+
+    audio = get_audio(shorten=True)
+
+    bp_model = BasiCPP_Pitch.amtModel()
+    gold = bp_model.transcribeAudio(audio)
+
+    # sessions share the weights of bp_model and run concurrently
+    sessions = [BasiCPP_Pitch.amtModel(bp_model) for _ in range(3)]
+    with ThreadPoolExecutor(max_workers=3) as executor:
+        results = list(executor.map(lambda session: session.transcribeAudio(audio), sessions))
+
+    for notes in results:
+        assert len(notes) == len(gold)
+        for note, gold_note in zip(notes, gold):
+            assert (note.start_frame, note.end_frame, note.pitch) == (gold_note.start_frame, gold_note.end_frame, gold_note.pitch)
+
+
+def test_model_config():
+    import BasiCPP_Pitch
+
+    audio = get_audio(shorten=True)
+    gold = BasiCPP_Pitch.amtModel().transcribeAudio(audio)
+
+    # parts load on first use, from an explicit model directory
+    config = BasiCPP_Pitch.ModelConfig()
+    config.model_dir = "model"
+    config.lazy = True
+    notes = BasiCPP_Pitch.amtModel(config).transcribeAudio(audio)
+
+    assert len(notes) == len(gold)
+    for note, gold_note in zip(notes, gold):
+        assert (note.start_frame, note.end_frame, note.pitch) == (gold_note.start_frame, gold_note.end_frame, gold_note.pitch)
+
+    # sessions of one process share one set of weights
+    assert BasiCPP_Pitch.amtModel().getWeights() is BasiCPP_Pitch.amtModel().getWeights()
+    assert BasiCPP_Pitch.amtWeights.shared() is BasiCPP_Pitch.amtModel().getWeights()
+
+    # only sessions of the same config share weights
+    lazy_weights = BasiCPP_Pitch.amtWeights.shared(config)
+    assert lazy_weights is BasiCPP_Pitch.amtWeights.shared(config)
+    assert lazy_weights is not BasiCPP_Pitch.amtWeights.shared()
+
+    # a missing directory surfaces as an error on first use, naming the missing model file
+    config.model_dir = "no_such_dir"
+    try:
+        BasiCPP_Pitch.amtModel(config).transcribeAudio(audio)
+        assert False
+    except RuntimeError as e:
+        assert "no_such_dir/" in str(e)
+
+
+def test_embedded_model(tmp_path, monkeypatch):
+    import BasiCPP_Pitch
+    import pytest
+
+    if not BasiCPP_Pitch.EMBED_MODEL:
+        pytest.skip("built without EMBED_MODEL")
+    fingerprint = BasiCPP_Pitch.amtWeights().fingerprint()
+
+    # the default model needs no model directory, other directories are still read from disk
+    monkeypatch.chdir(tmp_path)
+    assert BasiCPP_Pitch.amtWeights().fingerprint() == fingerprint
+    config = BasiCPP_Pitch.ModelConfig()
+    config.model_dir = "no_such_dir"
+    try:
+        BasiCPP_Pitch.amtWeights(config)
+        assert False
+    except RuntimeError:
+        pass
+
+
+def test_model_handle():
+    import BasiCPP_Pitch
+    import threading
+
+    audio = get_audio(shorten=True)
+    handle = BasiCPP_Pitch.ModelHandle()
+    session = BasiCPP_Pitch.amtModel(handle)
+    gold = session.transcribeAudio(audio)
+    old_weights = session.getWeights()
+    assert handle.version() == 1
+
+    # swap while a transcription runs, it finishes on the weights it started with
+    results = []
+    worker = threading.Thread(target=lambda: results.append(session.transcribeAudio(audio)))
+    worker.start()
+    assert handle.reload(BasiCPP_Pitch.ModelConfig()) == 2
+    worker.join()
+    assert len(results[0]) == len(gold)
+
+    # the next transcription runs on the new version
+    session.transcribeAudio(audio)
+    assert session.getWeights() is handle.get()
+    assert session.getWeights() is not old_weights
+
+    # a failed reload keeps the current version
+    config = BasiCPP_Pitch.ModelConfig()
+    config.model_dir = "no_such_dir"
+    try:
+        handle.reload(config)
+        assert False
+    except RuntimeError:
+        pass
+    assert handle.version() == 2
+
+
 if __name__ == "__main__":
     test_inference(vis=True)
     # test_amtModelCQ()
\ No newline at end of file
@@ -0,0 +1,64 @@
+import numpy as np
+import os
+
+def test_batch(tmp_path, write_wav):
+    import BasiCPP_Pitch
+
+    os.makedirs(tmp_path / 'clips' / 'sub')
+    paths = []
+    for i, sample_rate in enumerate([22050, 44100, 48000]):
+        t = np.arange(sample_rate * (i + 1)) / sample_rate
+        path = tmp_path / 'clips' / ('sub' if i % 2 else '') / f'clip{i}.wav'
+        write_wav(path, (0.5 * np.sin(2 * np.pi * 220 * 2 ** (i / 12) * t))[:, None], sample_rate)
+        paths.append(str(path))
+    (tmp_path / 'bad.wav').write_bytes(b'not a wav file')
+    (tmp_path / 'list.txt').write_text(str(tmp_path / 'bad.wav') + '\n')
+
+    files = BasiCPP_Pitch.collectInputFiles([str(tmp_path / 'clips'), '@' + str(tmp_path / 'list.txt')])
+    assert files == sorted(paths) + [str(tmp_path / 'bad.wav')]
+
+    bp_model = BasiCPP_Pitch.amtModel()
+    config = BasiCPP_Pitch.BatchConfig()
+    config.output_dir = str(tmp_path / 'out')
+    config.write_notes = True
+    config.max_in_flight = 2
+    results = BasiCPP_Pitch.transcribeBatch(bp_model, files, config)
+
+    assert [r.path for r in results] == files
+    assert results[-1].error != ''
+    for r in results[:-1]:
+        assert r.error == ''
+        stem = os.path.splitext(os.path.basename(r.path))[0]
+        assert os.path.exists(tmp_path / 'out' / (stem + '.mid'))
+        # the same notes as a single transcription of the decoded file
+        audio, _ = BasiCPP_Pitch.loadWav(r.path)
+        gold = bp_model.transcribeAudio(audio)
+        notes = BasiCPP_Pitch.note.readNoteArray(str(tmp_path / 'out' / (stem + '.notes')))
+        assert r.n_notes == len(gold) == len(notes.pitch)
+        assert list(notes.pitch) == [n.pitch for n in gold]
+        assert abs(r.audio_seconds - audio.shape[0] / 22050) < 1e-6
+
+def test_batch_same_name(tmp_path, write_wav):
+    import BasiCPP_Pitch
+
+    t = np.arange(22050) / 22050
+    for i, sub in enumerate(['a', 'b']):
+        os.makedirs(tmp_path / 'clips' / sub)
+        write_wav(tmp_path / 'clips' / sub / 'take.wav', (0.5 * np.sin(2 * np.pi * 220 * (i + 1) * t))[:, None], 22050)
+    files = BasiCPP_Pitch.collectInputFiles([str(tmp_path / 'clips')])
+
+    # both would write out/take.mid, the second one fails instead of overwriting the first
+    bp_model = BasiCPP_Pitch.amtModel()
+    config = BasiCPP_Pitch.BatchConfig()
+    config.output_dir = str(tmp_path / 'out')
+    results = BasiCPP_Pitch.transcribeBatch(bp_model, files, config)
+    assert results[0].error == ''
+    assert files[0] in results[1].error
+    assert os.listdir(tmp_path / 'out') == ['take.mid']
+    audio, _ = BasiCPP_Pitch.loadWav(files[0])
+    assert results[0].n_notes == len(bp_model.transcribeAudio(audio))
+
+    # next to their inputs they do not collide
+    results = BasiCPP_Pitch.transcribeBatch(bp_model, files)
+    assert all(r.error == '' for r in results)
+    assert all(os.path.exists(os.path.splitext(f)[0] + '.mid') for f in files)
@@ -21,5 +21,57 @@ def test_weight():
     assert np.allclose(weights, gold[0, 0, :, :].squeeze())
  
 
+def test_model_file(tmp_path):
+    import BasiCPP_Pitch
+
+    bin_path = str(tmp_path / "contour.bin")
+    BasiCPP_Pitch.convertModel("model/cnn_contour_model.json", bin_path)
+
+    json_cnn = BasiCPP_Pitch.CNN("Contour", "model/cnn_contour_model.json")
+    bin_cnn = BasiCPP_Pitch.CNN("Contour", bin_path)
+
+    assert np.array_equal(json_cnn.getFirstKernel(), bin_cnn.getFirstKernel())
+
+    x = np.random.rand(8, 40, 264).astype(np.float32)
+    assert np.array_equal(json_cnn.forward(x), bin_cnn.forward(x))
+
+    # a flipped byte is caught by the checksum
+    data = bytearray(open(bin_path, "rb").read())
+    data[-1] ^= 1
+    bad_path = str(tmp_path / "bad.bin")
+    open(bad_path, "wb").write(data)
+    try:
+        BasiCPP_Pitch.CNN("Contour", bad_path)
+        assert False
+    except RuntimeError:
+        pass
+
+
+def test_model_file_version(tmp_path):
+    import BasiCPP_Pitch
+    import shutil
+
+    # binary models of another format version are skipped for the json models next to them
+    model_dir = tmp_path / "model"
+    shutil.copytree("model", model_dir)
+    for name in ["contour", "note", "onset_1", "onset_2"]:
+        bin_path = str(model_dir / f"cnn_{name}_model.bin")
+        BasiCPP_Pitch.convertModel(str(model_dir / f"cnn_{name}_model.json"), bin_path)
+        data = bytearray(open(bin_path, "rb").read())
+        data[4:8] = np.uint32(1).tobytes()
+        open(bin_path, "wb").write(data)
+
+    config = BasiCPP_Pitch.ModelConfig()
+    config.model_dir = str(model_dir)
+    assert BasiCPP_Pitch.amtWeights(config).fingerprint() == BasiCPP_Pitch.amtWeights().fingerprint()
+
+    # an explicit binary model file still has to match
+    try:
+        BasiCPP_Pitch.CNN("Contour", str(model_dir / "cnn_contour_model.bin"))
+        assert False
+    except RuntimeError:
+        pass
+
+
 if __name__ == '__main__':
     test_weight()
\ No newline at end of file
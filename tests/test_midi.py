@@ -0,0 +1,81 @@
+import numpy as np
+
+def overlapping(notes):
+    """Indices of notes overlapping another one, their bends are not written"""
+    order = sorted(range(len(notes)), key=lambda i: notes[i].start)
+    result = set()
+    for a, i in enumerate(order):
+        for j in order[a + 1:]:
+            if notes[j].start >= notes[i].end:
+                break
+            result.update((i, j))
+    return result
+
+def test_write_midi(tmp_path):
+    from BasiCPP_Pitch.note import modelOutput2Notes, modelOutput2NoteArray
+    from BasiCPP_Pitch.midi import writeMidi
+    import pretty_midi
+
+    import warnings
+    warnings.simplefilter("ignore")
+    with warnings.catch_warnings():
+        from basic_pitch.inference import predict
+        model_output, _, _ = predict("data/Undertale-Megalovania.wav")
+
+    Yp, Yn, Yo = model_output['contour'], model_output['note'], model_output['onset']
+    notes = modelOutput2Notes( Yp, Yn, Yo, True, True )
+
+    path = str(tmp_path / "notes.mid")
+    writeMidi(notes, path)
+    midi = pretty_midi.PrettyMIDI(path)
+    midi_notes = sorted(midi.instruments[0].notes, key=lambda n: (n.start, n.pitch))
+    gold = sorted(notes, key=lambda n: (n.start, n.pitch))
+
+    assert len(midi_notes) == len(gold)
+    for note, gold_note in zip(midi_notes, gold):
+        assert note.pitch == gold_note.pitch
+        assert note.velocity == max(1, round(gold_note.amplitude * 127))
+        # one tick at 115 bpm with 220 ticks per beat is ~2.4 ms
+        assert abs(note.start - gold_note.start) < 3e-3
+        assert abs(note.end - gold_note.end) < 3e-3
+    # bends of overlapping notes are dropped, the wheel is centered at the end of each bent note
+    dropped = overlapping(notes)
+    assert len(midi.instruments[0].pitch_bends) == sum(
+        len(n.bends) + 1 for i, n in enumerate(notes) if len(n.bends) > 0 and i not in dropped)
+
+    # SoA notes produce the same file
+    array_path = str(tmp_path / "note_array.mid")
+    writeMidi(modelOutput2NoteArray( Yp, Yn, Yo, True, True ), array_path)
+    assert open(path, "rb").read() == open(array_path, "rb").read()
+
+def test_overlapping_pitch_bends(tmp_path):
+    from BasiCPP_Pitch.note import Note, NoteArray
+    from BasiCPP_Pitch.midi import writeMidi
+    import pretty_midi
+
+    def note(start_frame, end_frame, pitch, bends):
+        n = Note()
+        n.start_frame, n.end_frame, n.pitch, n.amplitude, n.bends = start_frame, end_frame, pitch, 0.5, bends
+        return n
+
+    # the first two notes overlap, times are derived from the frames
+    notes = NoteArray.fromNotes([
+        note(0, 80, 60, [0, 3, -3]),
+        note(40, 120, 64, [1, 2]),
+        note(160, 240, 67, [3, 3]),
+    ]).toNotes()
+
+    path = str(tmp_path / "overlap.mid")
+    writeMidi(notes, path)
+    midi = pretty_midi.PrettyMIDI(path)
+    assert len(midi.instruments[0].notes) == 3
+
+    # only the isolated note is bent, then the wheel is centered at its note off
+    bends = midi.instruments[0].pitch_bends
+    assert [b.pitch for b in bends] == [4096, 4096, 0]
+    assert all(b.time >= notes[2].start - 3e-3 for b in bends)
+    assert abs(bends[-1].time - notes[2].end) < 3e-3
+
+    array_path = str(tmp_path / "overlap_array.mid")
+    writeMidi(NoteArray.fromNotes(notes), array_path)
+    assert open(path, "rb").read() == open(array_path, "rb").read()
@@ -27,6 +27,22 @@ def test_infered_onsets():
 
     assert np.allclose(onsets, gold)
 
+def test_infered_onset_logits_saturated():
+    from BasiCPP_Pitch.note import getInferedOnsetLogits, modelOutput2Notes
+
+    # sigmoid(30) rounds to 1 in float, the inferred onset at the largest note jump must stay finite
+    Yn = np.zeros((8, 88), dtype=np.float32)
+    Yn[4:, 40] = 0.9
+    Yo = np.full((8, 88), -20, dtype=np.float32)
+    Yo[2, 10] = 30
+    onsets = getInferedOnsetLogits(Yo, Yn)
+    assert np.all(np.isfinite(onsets))
+    assert onsets[4, 40] > 0
+
+    # no onset probability exceeds 1
+    Yp = np.zeros((8, 264), dtype=np.float32)
+    assert len(modelOutput2Notes(Yp, Yn, Yo, onset_logits=True, onset_threshold=1.0)) == 0
+
 def test_model_output2note():
     # from BasiCPP_Pitch import amtModel
     from BasiCPP_Pitch.note import modelOutput2Notes
@@ -45,6 +61,81 @@ def test_model_output2note():
 
     assert len(notes) == len(gold)
 
+def test_pitch_bends():
+    from BasiCPP_Pitch.note import modelOutput2Notes
+
+    import warnings
+    warnings.simplefilter("ignore")
+    with warnings.catch_warnings():
+        from basic_pitch.inference import predict
+        from basic_pitch.note_creation import get_pitch_bends
+        model_output, _, _ = predict("data/Undertale-Megalovania.wav")
+
+    Yp, Yn, Yo = model_output['contour'], model_output['note'], model_output['onset']
+    notes = modelOutput2Notes( Yp, Yn, Yo, True, True )
+
+    note_events = [(n.start_frame, n.end_frame, n.pitch, n.amplitude) for n in notes]
+    gold = get_pitch_bends(Yp, note_events)
+
+    for note, gold_event in zip(notes, gold):
+        assert list(note.bends) == list(gold_event[4])
+
+def test_note_array(tmp_path):
+    from BasiCPP_Pitch.note import modelOutput2Notes, modelOutput2NoteArray, writeNoteArray, readNoteArray
+
+    import warnings
+    warnings.simplefilter("ignore")
+    with warnings.catch_warnings():
+        from basic_pitch.inference import predict
+        model_output, _, _ = predict("data/Undertale-Megalovania.wav")
+
+    Yp, Yn, Yo = model_output['contour'], model_output['note'], model_output['onset']
+    notes = modelOutput2Notes( Yp, Yn, Yo, True, True )
+    note_array = modelOutput2NoteArray( Yp, Yn, Yo, True, True )
+
+    assert len(note_array) == len(notes)
+    assert np.array_equal(note_array.pitch, [n.pitch for n in notes])
+    assert np.allclose(note_array.amplitude, [n.amplitude for n in notes])
+    for i, note in enumerate(notes):
+        assert list(note_array[i].bends) == list(note.bends)
+
+    # iteration and negative indices stop at the ends of the array
+    iterated = [note for note in note_array]
+    assert len(iterated) == len(notes)
+    assert [n.pitch for n in iterated] == [n.pitch for n in notes]
+    assert note_array[-1].pitch == notes[-1].pitch
+    for idx in (len(note_array), -len(note_array) - 1):
+        try:
+            note_array[idx]
+            assert False, "note index out of range was read"
+        except IndexError:
+            pass
+
+    path = str(tmp_path / "notes.bpna")
+    writeNoteArray(note_array, path)
+    loaded = readNoteArray(path)
+    assert np.array_equal(loaded.start_frame, note_array.start_frame)
+    assert np.array_equal(loaded.bends, note_array.bends)
+    assert np.array_equal(loaded.bend_offsets, note_array.bend_offsets)
+
+    # damaged files are rejected instead of indexing the bends out of range
+    data = open(path, "rb").read()
+    first_offset = 24 + 6 * 4 * len(note_array)
+    last_offset = first_offset + 4 * len(note_array)
+    damaged = [
+        data[:-4],
+        data[:first_offset] + np.int32(1).tobytes() + data[first_offset + 4:],
+        data[:last_offset] + np.int32(len(note_array.bends) + 1).tobytes() + data[last_offset + 4:],
+    ]
+    for i, bad in enumerate(damaged):
+        bad_path = str(tmp_path / f"bad{i}.bpna")
+        open(bad_path, "wb").write(bad)
+        try:
+            readNoteArray(bad_path)
+            assert False, "damaged note array was read"
+        except RuntimeError:
+            pass
+
 if __name__ == "__main__":
     # test_infered_onsets()
     test_model_output2note()
\ No newline at end of file
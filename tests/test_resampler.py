@@ -0,0 +1,29 @@
+import numpy as np
+
+def tones(t):
+    return 0.5 * np.sin(2 * np.pi * 1000 * t) + 0.3 * np.sin(2 * np.pi * 3000 * t)
+
+def test_resample():
+    import BasiCPP_Pitch
+
+    t_out = np.arange(22050 * 2) / 22050
+    for rate_in in [8000, 16000, 44100, 48000, 96000]:
+        t = np.arange(rate_in * 2) / rate_in
+        out = BasiCPP_Pitch.resample(tones(t).astype(np.float32), rate_in)
+        assert out.shape[0] == 22050 * 2
+        # away from the zeros around the signal
+        assert np.allclose(out[200:-200], tones(t_out)[200:-200], atol=1e-4)
+
+        # tones above the Nyquist frequency of the output are removed
+        if rate_in > 22050:
+            out = BasiCPP_Pitch.resample(np.sin(2 * np.pi * 13000 * t).astype(np.float32), rate_in)
+            assert np.abs(out[200:-200]).max() < 1e-3
+
+    audio = np.random.rand(1000).astype(np.float32)
+    assert np.array_equal(BasiCPP_Pitch.resample(audio, 22050), audio)
+
+def test_downmix():
+    import BasiCPP_Pitch
+
+    frames = np.random.rand(1000, 2).astype(np.float32)
+    assert np.allclose(BasiCPP_Pitch.downmix(frames), frames.mean(axis=1))
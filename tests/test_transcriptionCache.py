@@ -0,0 +1,98 @@
+import numpy as np
+import os
+
+def tone(seconds=6):
+    t = np.arange(22050 * seconds) / 22050
+    return (0.5 * np.sin(2 * np.pi * 440 * t) + 0.3 * np.sin(2 * np.pi * 660 * t)).astype(np.float32)
+
+# moves the entries of directory 100 s back, so later writes and hits are newer whatever the timestamp resolution
+def age(directory):
+    for name in os.listdir(directory):
+        stat = os.stat(directory / name)
+        os.utime(directory / name, ns=(stat.st_atime_ns, stat.st_mtime_ns - 100 * 10**9))
+
+def key(notes):
+    return [(n.start_frame, n.end_frame, n.pitch, n.amplitude, list(n.bends)) for n in notes]
+
+def test_cache(tmp_path):
+    import BasiCPP_Pitch
+
+    audio = tone()
+    bp_model = BasiCPP_Pitch.amtModel()
+    gold = bp_model.transcribeAudio(audio)
+    gold_Yo = np.array(bp_model.getYo())
+
+    cache = BasiCPP_Pitch.TranscriptionCache(str(tmp_path / 'cache'))
+    bp_model.setCache(cache)
+    assert key(bp_model.transcribeAudio(audio)) == key(gold)
+    assert (cache.hits(), cache.misses()) == (0, 1)
+    assert len(os.listdir(tmp_path / 'cache')) == 1
+
+    # a hit restores the notes and the posteriorgrams exactly, also for another session
+    other = BasiCPP_Pitch.amtModel()
+    other.setCache(cache)
+    notes = other.transcribeAudio(audio)
+    assert (cache.hits(), cache.misses()) == (1, 1)
+    assert key(notes) == key(gold)
+    assert np.array_equal(other.getYo(), gold_Yo)
+
+    # decoded again with other thresholds
+    assert key(other.decode()) == key(gold)
+    assert key(other.decode(onset_threshold=0.3, frame_threshold=0.2)) == \
+        key(BasiCPP_Pitch.note.modelOutput2Notes(other.getYp(), other.getYn(), other.getYo(),
+            onset_threshold=0.3, frame_threshold=0.2))
+
+    # other samples miss
+    other.transcribeAudio(audio[:-1])
+    assert cache.misses() == 2
+
+    # a damaged entry is a miss
+    for name in os.listdir(tmp_path / 'cache'):
+        with open(tmp_path / 'cache' / name, 'r+b') as f:
+            f.seek(100)
+            f.write(b'\xff' * 8)
+    assert key(other.transcribeAudio(audio)) == key(gold)
+    assert cache.misses() == 3
+
+    # so is one with a damaged frame count in the header
+    for name in os.listdir(tmp_path / 'cache'):
+        with open(tmp_path / 'cache' / name, 'r+b') as f:
+            f.seek(36)
+            f.write(b'\xff' * 4)
+    assert key(other.transcribeAudio(audio)) == key(gold)
+    assert cache.misses() == 4
+
+
+def test_cache_size_limit(tmp_path):
+    import BasiCPP_Pitch
+
+    audios = [tone(2) * gain for gain in (1.0, 0.9, 0.8)]
+    bp_model = BasiCPP_Pitch.amtModel()
+
+    # entry sizes, the names do not depend on the directory
+    bp_model.setCache(BasiCPP_Pitch.TranscriptionCache(str(tmp_path / 'unbounded')))
+    names = []
+    for audio in audios:
+        bp_model.transcribeAudio(audio)
+        names += [name for name in os.listdir(tmp_path / 'unbounded') if name not in names]
+    sizes = {name: os.path.getsize(tmp_path / 'unbounded' / name) for name in names}
+    assert len(sizes) == 3
+
+    # room for just under the three entries
+    cache = BasiCPP_Pitch.TranscriptionCache(str(tmp_path / 'cache'), max_bytes=sum(sizes.values()) - 1)
+    bp_model.setCache(cache)
+    for i in (0, 1, 0):
+        bp_model.transcribeAudio(audios[i])
+        age(tmp_path / 'cache')
+    assert (cache.hits(), cache.misses()) == (1, 2)
+
+    # the hit made the first entry more recent than the second, which is removed for the third
+    bp_model.transcribeAudio(audios[2])
+    assert sorted(os.listdir(tmp_path / 'cache')) == sorted([names[0], names[2]])
+    for i in (0, 2):
+        age(tmp_path / 'cache')
+        bp_model.transcribeAudio(audios[i])
+    assert (cache.hits(), cache.misses()) == (3, 3)
+    bp_model.transcribeAudio(audios[1])
+    assert cache.misses() == 4
+    assert sum(os.path.getsize(tmp_path / 'cache' / name) for name in os.listdir(tmp_path / 'cache')) <= cache.maxBytes()
@@ -0,0 +1,55 @@
+import numpy as np
+
+def test_load_wav(tmp_path, write_wav):
+    import BasiCPP_Pitch
+
+    t = np.arange(10000) / 22050
+    frames = np.stack([0.5 * np.sin(2 * np.pi * 440 * t), 0.25 * np.cos(2 * np.pi * 300 * t)], axis=1)
+    write_wav(tmp_path / 'stereo.wav', frames)
+
+    audio, sample_rate = BasiCPP_Pitch.loadWav(str(tmp_path / 'stereo.wav'))
+    assert sample_rate == 22050
+    assert np.allclose(audio, frames.mean(axis=1), atol=1e-4)
+
+    reader = BasiCPP_Pitch.WavReader(str(tmp_path / 'stereo.wav'))
+    info = reader.info()
+    assert (info.n_channels, info.n_frames, info.bits_per_sample, info.is_float) == (2, 10000, 16, False)
+    chunks = [reader.readFrames(4096) for _ in range(3)]
+    assert [c.shape[0] for c in chunks] == [4096, 4096, 10000 - 2 * 4096]
+    assert np.allclose(np.concatenate(chunks), frames, atol=1e-4)
+
+def test_many_channels(tmp_path, write_wav):
+    import BasiCPP_Pitch
+
+    # more channels than the downmix buffer holds samples
+    n_channels = 2000
+    rng = np.random.default_rng(0)
+    frames = rng.uniform(-0.5, 0.5, (600, n_channels))
+    write_wav(tmp_path / 'many.wav', frames)
+
+    audio, sample_rate = BasiCPP_Pitch.loadWav(str(tmp_path / 'many.wav'))
+    assert sample_rate == 22050
+    assert np.allclose(audio, frames.mean(axis=1), atol=1e-4)
+
+def test_transcribe_file(tmp_path, write_wav):
+    import BasiCPP_Pitch
+
+    t = np.arange(22050 * 3) / 22050
+    frames = (0.5 * np.sin(2 * np.pi * 440 * t))[:, None]
+    write_wav(tmp_path / 'tone.wav', frames)
+    audio, _ = BasiCPP_Pitch.loadWav(str(tmp_path / 'tone.wav'))
+
+    bp_model = BasiCPP_Pitch.amtModel()
+    gold = bp_model.transcribeAudio(audio)
+
+    # the whole file fits into one decoded block
+    config = BasiCPP_Pitch.StreamConfig()
+    config.context_frames = audio.shape[0]
+    notes = bp_model.transcribeFile(str(tmp_path / 'tone.wav'), config)
+    assert [(n.start_frame, n.end_frame, n.pitch) for n in notes] == [(n.start_frame, n.end_frame, n.pitch) for n in gold]
+
+    # other sample rates are resampled while streaming
+    t = np.arange(44100 * 3) / 44100
+    write_wav(tmp_path / 'tone44.wav', (0.5 * np.sin(2 * np.pi * 440 * t))[:, None], 44100)
+    notes = bp_model.transcribeFile(str(tmp_path / 'tone44.wav'), config)
+    assert {n.pitch for n in notes} == {n.pitch for n in gold}
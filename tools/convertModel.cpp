@@ -0,0 +1,40 @@
+// convert json model weights to the binary model format, see modelFile.h
+// usage: convert_model                      convert the default models in model/ next to their json files
+//        convert_model <in.json> <out.bin>  convert one model
+#include "loader.h"
+#include "modelFile.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+void convert( const std::string& json_path, const std::string& bin_path ) {
+    std::vector<Layer*> layers;
+    loadJsonLayers(layers, json_path);
+    writeModelFile(layers, bin_path);
+    for ( Layer* layer : layers )
+        delete layer;
+    std::cout << json_path << " -> " << bin_path << std::endl;
+}
+
+int main( int argc, char** argv ) {
+    try {
+        if ( argc == 3 ) {
+            convert(argv[1], argv[2]);
+        }
+        else if ( argc == 1 ) {
+            for ( const std::string name : { "Contour", "Note", "Onset Input", "Onset Output" } ) {
+                const std::string json_path = getModelPath(name);
+                convert(json_path, json_path.substr(0, json_path.size() - 5) + ".bin");
+            }
+        }
+        else {
+            std::cerr << "usage: " << argv[0] << " [<in.json> <out.bin>]" << std::endl;
+            return 1;
+        }
+    }
+    catch ( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
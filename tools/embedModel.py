@@ -0,0 +1,139 @@
+"""Generate the C++ source holding the CNN weights, the CQT kernel and the low pass filter as constexpr data,
+see src/embeddedModel.h.
+
+usage: python3 tools/embedModel.py <model dir> <output .cpp>
+"""
+import ast
+import json
+import os
+import struct
+import sys
+
+# model name used by CNN -> json file, as in getModelPath of loader.cpp
+MODELS = {
+    "Contour": "cnn_contour_model.json",
+    "Note": "cnn_note_model.json",
+    "Onset Input": "cnn_onset_1_model.json",
+    "Onset Output": "cnn_onset_2_model.json",
+}
+
+
+def float_literal(v):
+    # round to float32 once, like the json loader, and print exactly
+    return struct.unpack("f", struct.pack("f", v))[0].hex() + "f"
+
+
+def read_npy(path, descr):
+    # npy format 1.0 of a C order little endian array: magic, version, header length, header, data
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:6] != b"\x93NUMPY" or data[6] != 1:
+        sys.exit(f"{path} is not a npy 1.0 file")
+    header_len = struct.unpack("<H", data[8:10])[0]
+    header = ast.literal_eval(data[10:10 + header_len].decode("latin1"))
+    if header["descr"] != descr or header["fortran_order"]:
+        sys.exit(f"{path}: expected a C order {descr} array")
+    n_values = 1
+    for n in header["shape"]:
+        n_values *= n
+    # complex64 as interleaved real and imaginary parts
+    n_floats = n_values * (2 if descr == "<c8" else 1)
+    values = struct.unpack(f"<{n_floats}f", data[10 + header_len:10 + header_len + 4 * n_floats])
+    return header["shape"], list(values)
+
+
+def array(name, values, align=True):
+    body = ",\n    ".join(
+        ", ".join(float_literal(v) for v in values[i:i + 8]) for i in range(0, len(values), 8)
+    )
+    prefix = "alignas(64) " if align else ""
+    return f"{prefix}constexpr float {name}[{len(values)}] = {{\n    {body}\n}};\n"
+
+
+# output filters per block, Conv2D::kernelBlock
+KERNEL_BLOCK = 8
+
+
+def conv_kernel(weights, n_in, n_out, kt, kf):
+    # json: ( kernel_size_time, kernel_size_feature, n_filters_in, n_filters_out )
+    # Conv2D: ( n_filters_out / block, n_filters_in, kernel_size_time, kernel_size_feature, block )
+    block = KERNEL_BLOCK if n_out % KERNEL_BLOCK == 0 else 1
+    return [
+        weights[t][f][i][ob + o]
+        for ob in range(0, n_out, block)
+        for i in range(n_in)
+        for t in range(kt)
+        for f in range(kf)
+        for o in range(block)
+    ]
+
+
+def generate(model_dir):
+    data, builders = [], []
+    for m, (model_name, file_name) in enumerate(MODELS.items()):
+        with open(os.path.join(model_dir, file_name)) as f:
+            layers_json = json.load(f)["layers"]
+
+        layers = []
+        for l, layer in enumerate(layers_json):
+            prefix = f"model{m}_layer{l}"
+            if layer["type"] == "conv2d":
+                n_in, n_out = layer["num_filters_in"], layer["num_filters_out"]
+                kt, kf = layer["kernel_size_time"], layer["kernel_size_feature"]
+                data.append(array(prefix + "_kernel", conv_kernel(layer["weights"][0], n_in, n_out, kt, kf)))
+                data.append(array(prefix + "_bias", layer["weights"][1], False))
+                layers.append(
+                    f"new StaticConv2D<{n_in}, {n_out}, {kt}, {kf}, {layer['strides']}>"
+                    f"({layer['num_features_in']}, {prefix}_kernel, {prefix}_bias)"
+                )
+                activation = layer.get("activation", "")
+                if activation == "relu":
+                    layers.append("new ReLU()")
+                elif activation == "sigmoid":
+                    layers.append("new Sigmoid()")
+                elif activation:
+                    sys.exit(f"unknown activation function: {activation}")
+            elif layer["type"] == "relu":
+                layers.append("new ReLU()")
+            elif layer["type"] == "sigmoid":
+                layers.append("new Sigmoid()")
+            elif layer["type"] == "batchnorm2d":
+                names = ["gamma", "beta", "mean", "variance"]
+                for name, values in zip(names, layer["weights"]):
+                    data.append(array(f"{prefix}_{name}", values, False))
+                args = ", ".join(f"{prefix}_{name}" for name in names)
+                layers.append(f"new BatchNorm({len(layer['weights'][0])}, {args})")
+            else:
+                sys.exit(f"unknown layer type: {layer['type']}")
+
+        body = "".join(f"        layers.emplace_back({layer});\n" for layer in layers)
+        builders.append(f'    if ( model_name == "{model_name}" ) {{\n{body}        return true;\n    }}\n')
+
+    (n_bins, kernel_length), kernel = read_npy(os.path.join(model_dir, "kernel.npy"), "<c8")
+    data.append(array("cqt_kernel", kernel))
+    (filter_length,), filter_kernel = read_npy(os.path.join(model_dir, "lowpass_filter.npy"), "<f4")
+    data.append(array("lowpass_filter", filter_kernel))
+
+    return (
+        "// generated by tools/embedModel.py from the model directory, do not edit\n"
+        '#include "embeddedModel.h"\n'
+        '#include "staticConv2D.h"\n\n'
+        "namespace {\n\n" + "\n".join(data) + "\n}\n\n"
+        "bool getEmbeddedLayers( std::vector<Layer*>& layers, const std::string& model_name ) {\n"
+        + "".join(builders)
+        + "    return false;\n}\n\n"
+        "const std::complex<float>* getEmbeddedKernel( int& n_bins, int& kernel_length ) {\n"
+        f"    n_bins = {n_bins};\n"
+        f"    kernel_length = {kernel_length};\n"
+        "    return reinterpret_cast<const std::complex<float>*>(cqt_kernel);\n}\n\n"
+        "void getEmbeddedLowPassFilter( Vectorf& filter_kernel ) {\n"
+        f"    filter_kernel = Eigen::Map<const Vectorf>(lowpass_filter, {filter_length});\n}}\n"
+    )
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    source = generate(sys.argv[1])
+    with open(sys.argv[2], "w") as f:
+        f.write(source)